@@ -7,7 +7,7 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include "filesystem_function_kernel.h"
+#include <pthread.h>
 #include "filesystem_structs.h"
 
 #ifndef _RD_FUNCTIONS
@@ -22,24 +22,57 @@
 #define RD_LSEEK _IOWR(0, 17, struct lseekParam)
 #define RD_MKDIR _IOWR(0, 18, struct pathParam)
 #define RD_READDIR _IOWR(0, 19, struct readdirParam)
+#define RD_SNAPSHOT _IOWR(0, 20, struct imageParam)
+#define RD_RESTORE _IOWR(0, 21, struct imageParam)
+#define RD_CLONE _IOWR(0, 22, struct pathPairParam)
+#define RD_SETFLAGS _IOWR(0, 23, struct flagsParam)
+#define RD_ZERO_RANGE _IOWR(0, 24, struct zeroRangeParam)
+#define RD_RENAME _IOWR(0, 25, struct pathPairParam)
+#define RD_LINK _IOWR(0, 26, struct pathPairParam)
+#define RD_STAT _IOWR(0, 27, struct statParam)
+#define RD_READDIRPLUS _IOWR(0, 28, struct readdirplusParam)
+#define RD_CREATAT _IOWR(0, 29, struct atParam)
+#define RD_MKDIRAT _IOWR(0, 30, struct atParam)
+#define RD_OPENAT _IOWR(0, 31, struct atParam)
+#define RD_UNLINKAT _IOWR(0, 32, struct atParam)
+#define RD_OPEN_BY_HANDLE _IOWR(0, 33, struct openHandleParam)
+#define RD_RMTREE _IOWR(0, 34, struct pathParam)
+#define RD_CREATE_MANY _IOWR(0, 35, struct createManyParam)
+#define RD_FRAG_REPORT _IOWR(0, 36, struct fragReportParam)
+#define RD_DEFRAG _IOWR(0, 37, struct pathParam)
 
 #endif
 
 struct fileDescriptor
 {
   int fd;
-  int inodeNum;
-  int filePosition;
-};
+  int handle; // kernel open file, owns the read/write position and the directory cursor
+  int position; // last known kernel position, where buffered writes land
 
-// file descriptor functions
-static void addToFDTable(struct fileDescriptor *fileDescriptor);
-static void removeFromFDTable(struct fileDescriptor *fileDescriptor);
-static struct fileDescriptor *FDSearch(int fd);
+  // optional write-combining buffer, see rd_setwritebuf
+  char *writeBuffer;
+  int writeBufferSize;
+  int writeBufferLen;
+
+  // held from FDSearch until FDRelease, so one operation at a time uses the slot
+  pthread_mutex_t lock;
+  int users; // lookups still holding the slot, it is only recycled once this drops to 0
 
+  int inUse;
+  int nextFree; // next free slot index while on the free list, -1 ends the list
+};
 
+// write buffer functions
+static int bufferedWrite(struct fileDescriptor *fileDescriptor, char *address, int numBytes);
+static int writeThrough(struct fileDescriptor *fileDescriptor, char *address, int numBytes);
+static int flushWriteBuffer(struct fileDescriptor *fileDescriptor, int alignedOnly);
 
-static int currentFD = 1;
+// file descriptor functions
+static struct fileDescriptor *addToFDTable(int handle);
+static struct fileDescriptor *claimFromFDTable(int fd);
+static void restoreToFDTable(struct fileDescriptor *fileDescriptor);
+static struct fileDescriptor *FDSearch(int fd);
+static void FDRelease(struct fileDescriptor *fileDescriptor);
 
 
 
@@ -93,6 +126,28 @@ static int rd_unlink(char *path)
   return 0;
 }
 
+// release the kernel open file at handle, -1 if the request never reached the kernel
+// a handle the kernel doesn't know is as good as released
+static int closeHandle(int handle) {
+  int fd_ioctl = open("/proc/ramdisk", O_RDONLY);
+  if (fd_ioctl < 0) {
+    return -1;
+  }
+
+  struct closeParam closeParams = {
+    .returnVal = -1,
+    .handle = handle
+  };
+
+  int ret = ioctl(fd_ioctl, RD_CLOSE, &closeParams);
+  close(fd_ioctl);
+  if (ret != 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
 // open file at path
 static int rd_open(char *path) {
   int fd_ioctl = open("/proc/ramdisk", O_RDONLY);
@@ -118,48 +173,142 @@ static int rd_open(char *path) {
     return -1;
   }
 
-  int inodeNum = openParams.inodeNum;
-
-  // create file descriptor for open file
-  struct fileDescriptor *fileDescriptor = (struct fileDescriptor *)malloc(sizeof(struct fileDescriptor)); 
-  fileDescriptor->inodeNum = inodeNum;
-  fileDescriptor->fd = currentFD++;
-  fileDescriptor->filePosition = 0;
-  addToFDTable(fileDescriptor); 
+  // take a slot in the file descriptor table for the open file
+  struct fileDescriptor *fileDescriptor = addToFDTable(openParams.handle);
+  if (NULL == fileDescriptor) {
+    closeHandle(openParams.handle); // no fd will ever close it
+    return -1;
+  }
 
   return fileDescriptor->fd;
 }
 
 
 
-// close file at fd
-static int rd_close(int fd) {
-  struct fileDescriptor *fileDescriptor = FDSearch(fd);
-
-  if (NULL == fileDescriptor) {
+// open the file fileHandle names, from rd_name_to_handle or rd_stat, return the new fd
+// fails once the file was unlinked, even if its inode was reused since
+static int rd_open_by_handle(struct rd_file_handle *fileHandle) {
+  if (NULL == fileHandle) {
     return -1;
   }
 
   int fd_ioctl = open("/proc/ramdisk", O_RDONLY);
-
   if (fd_ioctl < 0) {
-    return -1; 
+    return -1;
   }
 
-  struct closeParam closeParams = {
+  struct openHandleParam openHandleParams = {
     .returnVal = -1,
-    .inodeNum = fileDescriptor->inodeNum
+    .fileHandle = *fileHandle
   };
 
-  if (ioctl(fd_ioctl, RD_CLOSE, &closeParams) != 0) {
+  if (ioctl(fd_ioctl, RD_OPEN_BY_HANDLE, &openHandleParams) != 0) {
     close(fd_ioctl);
     return -1;
   }
 
   close(fd_ioctl);
 
-  removeFromFDTable(fileDescriptor);
-  free(fileDescriptor);
+  if (openHandleParams.returnVal != 0) {
+    return -1;
+  }
+
+  // take a slot in the file descriptor table for the open file
+  struct fileDescriptor *fileDescriptor = addToFDTable(openHandleParams.handle);
+  if (NULL == fileDescriptor) {
+    closeHandle(openHandleParams.handle); // no fd will ever close it
+    return -1;
+  }
+
+  return fileDescriptor->fd;
+}
+
+// issue an *at ioctl for path relative to the directory open at dirfd, atParams receives the result
+static int pathAtIoctl(int dirfd, char *path, unsigned long cmd, struct atParam *atParams) {
+  struct fileDescriptor *fileDescriptor = FDSearch(dirfd);
+  if (NULL == fileDescriptor) {
+    return -1;
+  }
+
+  int fd_ioctl = open("/proc/ramdisk", O_RDONLY);
+  if (fd_ioctl < 0) {
+    FDRelease(fileDescriptor);
+    return -1;
+  }
+
+  atParams->returnVal = -1;
+  atParams->dirHandle = fileDescriptor->handle;
+  atParams->path = (const char *)path;
+  atParams->pathLen = (int)strlen(path);
+
+  // dirfd stays held until the kernel is done with its handle
+  int ret = ioctl(fd_ioctl, cmd, atParams);
+  close(fd_ioctl);
+  FDRelease(fileDescriptor);
+  if (ret != 0) {
+    return -1;
+  }
+
+  return atParams->returnVal;
+}
+
+// create file at path relative to the directory open at dirfd
+static int rd_creatat(int dirfd, char *path) {
+  struct atParam atParams;
+  return pathAtIoctl(dirfd, path, RD_CREATAT, &atParams);
+}
+
+// create directory at path relative to the directory open at dirfd
+static int rd_mkdirat(int dirfd, char *path) {
+  struct atParam atParams;
+  return pathAtIoctl(dirfd, path, RD_MKDIRAT, &atParams);
+}
+
+// unlink path relative to the directory open at dirfd
+static int rd_unlinkat(int dirfd, char *path) {
+  struct atParam atParams;
+  return pathAtIoctl(dirfd, path, RD_UNLINKAT, &atParams);
+}
+
+// open path relative to the directory open at dirfd, return the new fd
+static int rd_openat(int dirfd, char *path) {
+  struct atParam atParams;
+  if (0 != pathAtIoctl(dirfd, path, RD_OPENAT, &atParams)) {
+    return -1;
+  }
+
+  // take a slot in the file descriptor table for the open file
+  struct fileDescriptor *fileDescriptor = addToFDTable(atParams.handle);
+  if (NULL == fileDescriptor) {
+    closeHandle(atParams.handle); // no fd will ever close it
+    return -1;
+  }
+
+  return fileDescriptor->fd;
+}
+
+
+// close file at fd
+static int rd_close(int fd) {
+  // claimed before anything is flushed, so a second close of fd fails instead of closing twice
+  struct fileDescriptor *fileDescriptor = claimFromFDTable(fd);
+
+  if (NULL == fileDescriptor) {
+    return -1;
+  }
+
+  // push out buffered writes before the kernel open file goes away
+  // on failure fd stays open, as it was before the call
+  if ((0 != flushWriteBuffer(fileDescriptor, 0)) || (0 != closeHandle(fileDescriptor->handle))) {
+    restoreToFDTable(fileDescriptor);
+    FDRelease(fileDescriptor);
+    return -1;
+  }
+
+  free(fileDescriptor->writeBuffer);
+  fileDescriptor->writeBuffer = NULL;
+  fileDescriptor->writeBufferSize = 0;
+  FDRelease(fileDescriptor);
 
   return 0;
 }
@@ -173,32 +322,41 @@ static int rd_read(int fd, char *address, int numBytes) {
     return -1;
   }
 
+  // reads must see buffered writes
+  if (0 != flushWriteBuffer(fileDescriptor, 0)) {
+    FDRelease(fileDescriptor);
+    return -1;
+  }
+
   int fd_ioctl = open("/proc/ramdisk", O_RDONLY);
 
   if (fd_ioctl < 0) {
+    FDRelease(fileDescriptor);
     return -1;
   }
 
   struct rwParam readParams = {
     .returnVal = -1,
-    .inodeNum = fileDescriptor->inodeNum,
-    .filePosition = fileDescriptor->filePosition,
+    .handle = fileDescriptor->handle,
     .address = address,
     .numBytes = numBytes
   };
 
   if (ioctl(fd_ioctl, RD_READ, &readParams) != 0) {
     close(fd_ioctl);
+    FDRelease(fileDescriptor);
     return -1;
   }
 
   close(fd_ioctl);
 
   if (readParams.returnVal < 0) {
+    FDRelease(fileDescriptor);
     return -1;
   }
 
-  fileDescriptor->filePosition += readParams.returnVal;
+  fileDescriptor->position = readParams.filePosition;
+  FDRelease(fileDescriptor);
 
   return readParams.returnVal;
 }
@@ -212,6 +370,51 @@ static int rd_write(int fd, char *address, int numBytes) {
     return -1;
   }
 
+  int ret = bufferedWrite(fileDescriptor, address, numBytes);
+  FDRelease(fileDescriptor);
+
+  return ret;
+}
+
+
+// write through the write buffer of fileDescriptor, caller holds the slot
+static int bufferedWrite(struct fileDescriptor *fileDescriptor, char *address, int numBytes) {
+  // unbuffered, or too large to be worth combining
+  if ((NULL == fileDescriptor->writeBuffer) || (numBytes >= fileDescriptor->writeBufferSize)) {
+    if (0 != flushWriteBuffer(fileDescriptor, 0)) {
+      return -1;
+    }
+    return writeThrough(fileDescriptor, address, numBytes);
+  }
+
+  // make room, preferably by writing out only whole blocks so the tail keeps combining
+  if ((fileDescriptor->writeBufferLen + numBytes) > fileDescriptor->writeBufferSize) {
+    if (0 != flushWriteBuffer(fileDescriptor, 1)) {
+      return -1;
+    }
+    if ((fileDescriptor->writeBufferLen + numBytes) > fileDescriptor->writeBufferSize) {
+      if (0 != flushWriteBuffer(fileDescriptor, 0)) {
+        return -1;
+      }
+    }
+  }
+
+  memcpy(fileDescriptor->writeBuffer + fileDescriptor->writeBufferLen, address, numBytes);
+  fileDescriptor->writeBufferLen += numBytes;
+
+  // flush threshold reached
+  if (fileDescriptor->writeBufferLen == fileDescriptor->writeBufferSize) {
+    if (0 != flushWriteBuffer(fileDescriptor, 0)) {
+      return -1;
+    }
+  }
+
+  return numBytes;
+}
+
+
+// hand numBytes at address straight to the kernel at the current position
+static int writeThrough(struct fileDescriptor *fileDescriptor, char *address, int numBytes) {
   int fd_ioctl = open("/proc/ramdisk", O_RDONLY);
 
   if (fd_ioctl < 0) {
@@ -220,8 +423,7 @@ static int rd_write(int fd, char *address, int numBytes) {
 
   struct rwParam writeParams = {
     .returnVal = -1,
-    .inodeNum = fileDescriptor->inodeNum,
-    .filePosition = fileDescriptor->filePosition,
+    .handle = fileDescriptor->handle,
     .address = address,
     .numBytes = numBytes
   };
@@ -237,12 +439,96 @@ static int rd_write(int fd, char *address, int numBytes) {
     return -1;
   }
 
-  fileDescriptor->filePosition += writeParams.returnVal;
+  fileDescriptor->position = writeParams.filePosition;
 
   return writeParams.returnVal;
 }
 
 
+// write out buffered bytes, alignedOnly keeps back the tail past the last block boundary
+// bytes the kernel could not take (ramdisk full) are dropped and reported as -1
+static int flushWriteBuffer(struct fileDescriptor *fileDescriptor, int alignedOnly) {
+  int flushLen = fileDescriptor->writeBufferLen;
+
+  if (alignedOnly) {
+    int end = fileDescriptor->position + fileDescriptor->writeBufferLen;
+    int alignedLen = (end - (end % RD_BLOCK_SIZE)) - fileDescriptor->position;
+    if (alignedLen > 0) {
+      flushLen = alignedLen;
+    }
+  }
+
+  if (0 == flushLen) {
+    return 0;
+  }
+
+  int written = writeThrough(fileDescriptor, fileDescriptor->writeBuffer, flushLen);
+  if (written != flushLen) {
+    fileDescriptor->writeBufferLen = 0;
+    return -1;
+  }
+
+  // keep the unflushed tail at the front of the buffer
+  fileDescriptor->writeBufferLen -= flushLen;
+  memmove(fileDescriptor->writeBuffer, fileDescriptor->writeBuffer + flushLen, fileDescriptor->writeBufferLen);
+
+  return 0;
+}
+
+
+// write out any buffered bytes of fd
+static int rd_flush(int fd) {
+  struct fileDescriptor *fileDescriptor = FDSearch(fd);
+
+  if (NULL == fileDescriptor) {
+    return -1;
+  }
+
+  int ret = flushWriteBuffer(fileDescriptor, 0);
+  FDRelease(fileDescriptor);
+
+  return ret;
+}
+
+
+// give fd a write buffer of size bytes (rounded up to whole blocks) to coalesce small
+// sequential writes, size 0 flushes and turns buffering off
+static int rd_setwritebuf(int fd, int size) {
+  if (size < 0) {
+    return -1;
+  }
+
+  struct fileDescriptor *fileDescriptor = FDSearch(fd);
+
+  if (NULL == fileDescriptor) {
+    return -1;
+  }
+
+  if (0 != flushWriteBuffer(fileDescriptor, 0)) {
+    FDRelease(fileDescriptor);
+    return -1;
+  }
+
+  free(fileDescriptor->writeBuffer);
+  fileDescriptor->writeBuffer = NULL;
+  fileDescriptor->writeBufferSize = 0;
+
+  int ret = 0;
+  if (size > 0) {
+    size = ((size + RD_BLOCK_SIZE - 1) / RD_BLOCK_SIZE) * RD_BLOCK_SIZE;
+    fileDescriptor->writeBuffer = (char *)malloc(size);
+    if (NULL == fileDescriptor->writeBuffer) {
+      ret = -1;
+    } else {
+      fileDescriptor->writeBufferSize = size;
+    }
+  }
+  FDRelease(fileDescriptor);
+
+  return ret;
+}
+
+
 // set file position to offset, return new position
 static int rd_lseek(int fd, int offset) {
   struct fileDescriptor *fileDescriptor = FDSearch(fd);
@@ -251,31 +537,41 @@ static int rd_lseek(int fd, int offset) {
     return -1;
   }
 
+  // buffered writes belong at the old position
+  if (0 != flushWriteBuffer(fileDescriptor, 0)) {
+    FDRelease(fileDescriptor);
+    return -1;
+  }
+
   int fd_ioctl = open("/proc/ramdisk", O_RDONLY);
 
   if (fd_ioctl < 0) {
+    FDRelease(fileDescriptor);
     return -1;
   }
 
   struct lseekParam lseekParams = {
     .returnVal = -1,
-    .inodeNum = fileDescriptor->inodeNum,
+    .handle = fileDescriptor->handle,
     .offset = offset,
     .offset_toReturn = -1
   };
 
   if (ioctl(fd_ioctl, RD_LSEEK, &lseekParams) != 0) {
     close(fd_ioctl);
+    FDRelease(fileDescriptor);
     return -1;
   }
 
   close(fd_ioctl);
 
   if (lseekParams.returnVal != 0) {
+    FDRelease(fileDescriptor);
     return -1;
   }
 
-  fileDescriptor->filePosition = lseekParams.offset_toReturn;
+  fileDescriptor->position = lseekParams.offset_toReturn;
+  FDRelease(fileDescriptor);
 
   return 0;
 }
@@ -324,22 +620,22 @@ static int rd_readdir(int fd, char *address) {
 
   int fd_ioctl = open("/proc/ramdisk", O_RDONLY);
   if (fd_ioctl < 0) {
+    FDRelease(fileDescriptor);
     return -1;
   }
 
   struct readdirParam readdirParams = {
     .returnVal = -1,
-    .inodeNum = fileDescriptor->inodeNum,
-    .filePosition = fileDescriptor->filePosition
+    .handle = fileDescriptor->handle
   };
 
-  if (ioctl(fd_ioctl, RD_READDIR, &readdirParams) != 0) {
-    close(fd_ioctl);
+  int ret = ioctl(fd_ioctl, RD_READDIR, &readdirParams);
+  close(fd_ioctl);
+  FDRelease(fileDescriptor);
+  if (ret != 0) {
     return -1;
   }
 
-  close(fd_ioctl);
-
   if (readdirParams.returnVal < 0) {
     return readdirParams.returnVal;
   }
@@ -348,72 +644,656 @@ static int rd_readdir(int fd, char *address) {
     memcpy(address, readdirParams.address, readdirParams.dirDataLen);
   }
 
-  fileDescriptor->filePosition = readdirParams.filePosition;
-
   return readdirParams.returnVal;
 }
 
 
-//file descriptor table
-static struct fileDescriptor fileDescriptors[1023];
-static struct fileDescriptor emptyDescriptor = {0};
-static int fdStart = -1;
-static int fdEnd = -1;
+// store up to maxEntries entries of the directory open at fd, each with its attributes, in entries
+// shares the readdir cursor, returns how many were stored and 0 at the end of the directory
+static int rd_readdirplus(int fd, struct rd_direntplus *entries, int maxEntries) {
+  if (NULL == entries) {
+    return -1;
+  }
 
+  struct fileDescriptor *fileDescriptor = FDSearch(fd);
+  if (NULL == fileDescriptor) {
+    return -1;
+  }
 
-// add file descriptor to array
-static void addToFDTable(struct fileDescriptor *fileDescriptor) {
-  if (fdStart == -1) { // empty list
-    fdStart = 0;
-    fdEnd = 0;
-  } else {
-    fdEnd++;
+  int fd_ioctl = open("/proc/ramdisk", O_RDONLY);
+  if (fd_ioctl < 0) {
+    FDRelease(fileDescriptor);
+    return -1;
   }
-  fileDescriptors[fdEnd] = *fileDescriptor;
+
+  struct readdirplusParam readdirplusParams = {
+    .returnVal = -1,
+    .handle = fileDescriptor->handle,
+    .address = entries,
+    .maxEntries = maxEntries
+  };
+
+  int ret = ioctl(fd_ioctl, RD_READDIRPLUS, &readdirplusParams);
+  close(fd_ioctl);
+  FDRelease(fileDescriptor);
+  if (ret != 0) {
+    return -1;
+  }
+
+  return readdirplusParams.returnVal;
 }
 
-// find file descriptor
-static struct fileDescriptor *FDSearch(int fd)
-{
-  for (int i = fdStart; i <= fdEnd; i++) {
-    if (fileDescriptors[i].fd == fd) {
-      return &fileDescriptors[i];
-    }
+
+// attributes of the file or directory at path into stat, without opening it
+static int rd_stat(char *path, struct rd_stat *stat) {
+  if (NULL == stat) {
+    return -1;
+  }
+
+  int fd = open("/proc/ramdisk", O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct statParam statParams = {
+    .returnVal = -1,
+    .path = (const char *)path,
+    .pathLen = (int)strlen(path)
+  };
+
+  if (ioctl(fd, RD_STAT, &statParams) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  close(fd);
+
+  if (0 == statParams.returnVal) {
+    *stat = statParams.stat;
+  }
+
+  return statParams.returnVal;
+}
+
+
+// store a handle for the file at path in fileHandle, to reopen it later without its path
+static int rd_name_to_handle(char *path, struct rd_file_handle *fileHandle) {
+  struct rd_stat stat;
+
+  if ((NULL == fileHandle) || (0 != rd_stat(path, &stat))) {
+    return -1;
+  }
+  fileHandle->inodeNum = stat.inodeNum;
+  fileHandle->generation = stat.generation;
+
+  return 0;
+}
+
+
+// clone file or directory at srcPath to dstPath, data is shared until either copy is written
+static int rd_clone(char *srcPath, char *dstPath) {
+  int fd = open("/proc/ramdisk", O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct pathPairParam cloneParams = {
+    .returnVal = -1,
+    .srcPath = (const char *)srcPath,
+    .srcPathLen = (int)strlen(srcPath),
+    .dstPath = (const char *)dstPath,
+    .dstPathLen = (int)strlen(dstPath)
+  };
+
+  if (ioctl(fd, RD_CLONE, &cloneParams) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  close(fd);
+
+  return cloneParams.returnVal;
+}
+
+
+// move srcPath to dstPath, replacing a closed dstPath of the same kind
+static int rd_rename(char *srcPath, char *dstPath) {
+  int fd = open("/proc/ramdisk", O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct pathPairParam renameParams = {
+    .returnVal = -1,
+    .srcPath = (const char *)srcPath,
+    .srcPathLen = (int)strlen(srcPath),
+    .dstPath = (const char *)dstPath,
+    .dstPathLen = (int)strlen(dstPath)
+  };
+
+  if (ioctl(fd, RD_RENAME, &renameParams) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  close(fd);
+
+  return renameParams.returnVal;
+}
+
+
+// make dstPath another name for the regular file at srcPath
+static int rd_link(char *srcPath, char *dstPath) {
+  int fd = open("/proc/ramdisk", O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct pathPairParam linkParams = {
+    .returnVal = -1,
+    .srcPath = (const char *)srcPath,
+    .srcPathLen = (int)strlen(srcPath),
+    .dstPath = (const char *)dstPath,
+    .dstPathLen = (int)strlen(dstPath)
+  };
+
+  if (ioctl(fd, RD_LINK, &linkParams) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  close(fd);
+
+  return linkParams.returnVal;
+}
+
+
+// remove path and everything below it in a single call, fails without removing anything
+// if a file or directory in the tree is open
+static int rd_rmtree(char *path) {
+  int fd = open("/proc/ramdisk", O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct pathParam rmtreeParams = {
+    .returnVal = -1,
+    .path = (const char *)path,
+    .pathLen = (int)strlen(path)
+  };
+
+  if (ioctl(fd, RD_RMTREE, &rmtreeParams) != 0) {
+    close(fd);
+    return -1;
   }
 
-  return NULL; // not found
+  close(fd);
+
+  return rmtreeParams.returnVal;
 }
 
-// remove file descriptor from array
-static void removeFromFDTable(struct fileDescriptor *fileDescriptor) {
-    if (fdStart == -1 || fdEnd == -1) { // List is empty
-        return;
+
+// create a regular file in the directory at dirPath for each of the count names, as many per call
+// as fit RD_MAX_NAMES_LEN, returns how many were created in order before the first failure
+static int rd_create_many(char *dirPath, char **names, int count) {
+  if ((NULL == names) || (count < 0)) {
+    return -1;
+  }
+
+  char *buffer = (char *)malloc(RD_MAX_NAMES_LEN);
+  if (NULL == buffer) {
+    return -1;
+  }
+
+  int fd = open("/proc/ramdisk", O_RDONLY);
+  if (fd < 0) {
+    free(buffer);
+    return -1;
+  }
+
+  int created = 0;
+  while (created < count) {
+    // pack the next names back to back, each with its NUL
+    int namesLen = 0;
+    int batch = 0;
+    while (created + batch < count) {
+      int len = (int)strlen(names[created + batch]) + 1;
+      if (namesLen + len > RD_MAX_NAMES_LEN) {
+        break;
+      }
+      memcpy(buffer + namesLen, names[created + batch], len);
+      namesLen = namesLen + len;
+      batch++;
+    }
+    if (0 == batch) {
+      break; // name longer than a whole call
     }
 
-    int foundIndex = -1;
+    struct createManyParam createManyParams = {
+      .returnVal = -1,
+      .dirPath = (const char *)dirPath,
+      .dirPathLen = (int)strlen(dirPath),
+      .names = buffer,
+      .namesLen = namesLen,
+      .count = batch
+    };
+
+    if ((ioctl(fd, RD_CREATE_MANY, &createManyParams) != 0) || (createManyParams.returnVal < 0)) {
+      if (0 == created) {
+        created = -1;
+      }
+      break;
+    }
+    created = created + createManyParams.returnVal;
+    if (createManyParams.returnVal < batch) {
+      break;
+    }
+  }
+
+  close(fd);
+  free(buffer);
+
+  return created;
+}
+
+
+// fill report with the free space layout of the ramdisk
+static int rd_fragreport(struct rd_frag_report *report) {
+  if (NULL == report) {
+    return -1;
+  }
+
+  int fd = open("/proc/ramdisk", O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct fragReportParam fragReportParams = {
+    .returnVal = -1
+  };
+
+  if (ioctl(fd, RD_FRAG_REPORT, &fragReportParams) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  close(fd);
+
+  if (0 == fragReportParams.returnVal) {
+    memcpy(report, &fragReportParams.report, sizeof(struct rd_frag_report));
+  }
+
+  return fragReportParams.returnVal;
+}
+
+
+// move the blocks of the regular file at path into one contiguous run, rd_stat reports its extents
+static int rd_defrag(char *path) {
+  int fd = open("/proc/ramdisk", O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct pathParam defragParams = {
+    .returnVal = -1,
+    .path = (const char *)path,
+    .pathLen = (int)strlen(path)
+  };
+
+  if (ioctl(fd, RD_DEFRAG, &defragParams) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  close(fd);
+
+  return defragParams.returnVal;
+}
+
+
+// zero length bytes at offset of fd, whole blocks in the range stop taking memory
+static int rd_zero_range(int fd, int offset, int length) {
+  struct fileDescriptor *fileDescriptor = FDSearch(fd);
+
+  if (NULL == fileDescriptor) {
+    return -1;
+  }
+
+  // buffered writes land before the range is zeroed
+  if (0 != flushWriteBuffer(fileDescriptor, 0)) {
+    FDRelease(fileDescriptor);
+    return -1;
+  }
+
+  int fd_ioctl = open("/proc/ramdisk", O_RDONLY);
+
+  if (fd_ioctl < 0) {
+    FDRelease(fileDescriptor);
+    return -1;
+  }
+
+  struct zeroRangeParam zeroRangeParams = {
+    .returnVal = -1,
+    .handle = fileDescriptor->handle,
+    .offset = offset,
+    .length = length
+  };
+
+  int ret = ioctl(fd_ioctl, RD_ZERO_RANGE, &zeroRangeParams);
+  close(fd_ioctl);
+  FDRelease(fileDescriptor);
+  if (ret != 0) {
+    return -1;
+  }
+
+  return zeroRangeParams.returnVal;
+}
+
+
+// set the RD_FLAG_* modes of the file or directory at path
+static int rd_setflags(char *path, int flags) {
+  int fd = open("/proc/ramdisk", O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct flagsParam flagsParams = {
+    .returnVal = -1,
+    .path = (const char *)path,
+    .pathLen = (int)strlen(path),
+    .flags = flags
+  };
+
+  if (ioctl(fd, RD_SETFLAGS, &flagsParams) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  close(fd);
+
+  return flagsParams.returnVal;
+}
+
+
+// copy the whole ramdisk image into address, imageLen receives its size
+// fails if bufLen is too small, address NULL just asks for the size
+static int rd_snapshot(char *address, int bufLen, int *imageLen) {
+  int fd_ioctl = open("/proc/ramdisk", O_RDONLY);
+  if (fd_ioctl < 0) {
+    return -1;
+  }
+
+  struct imageParam imageParams = {
+    .returnVal = -1,
+    .address = address,
+    .bufLen = bufLen,
+    .imageLen = 0
+  };
+
+  if (ioctl(fd_ioctl, RD_SNAPSHOT, &imageParams) != 0) {
+    close(fd_ioctl);
+    return -1;
+  }
+
+  close(fd_ioctl);
+
+  *imageLen = imageParams.imageLen;
 
-    // find the index of the file descriptor to be removed
-    for (int i = fdStart; i <= fdEnd; i++) {
-        if (fileDescriptors[i].fd == fileDescriptor->fd) {
-            foundIndex = i;
-            break;
-        }
+  return imageParams.returnVal;
+}
+
+
+// replace the ramdisk contents with an image from rd_snapshot, every file must be closed
+static int rd_restore(char *address, int imageLen) {
+  int fd_ioctl = open("/proc/ramdisk", O_RDONLY);
+  if (fd_ioctl < 0) {
+    return -1;
+  }
+
+  struct imageParam imageParams = {
+    .returnVal = -1,
+    .address = address,
+    .bufLen = imageLen,
+    .imageLen = imageLen
+  };
+
+  if (ioctl(fd_ioctl, RD_RESTORE, &imageParams) != 0) {
+    close(fd_ioctl);
+    return -1;
+  }
+
+  close(fd_ioctl);
+
+  return imageParams.returnVal;
+}
+
+
+// write the ramdisk image to the file at path
+static int rd_snapshot_to_file(char *path) {
+  char *image = NULL;
+  int imageLen = 0;
+  int bufLen = 0;
+
+  // the image can grow between sizing and copying, retry until it fits
+  while (0 != rd_snapshot(image, bufLen, &imageLen)) {
+    if (imageLen <= bufLen) {
+      free(image);
+      return -1;
     }
+    free(image);
+    bufLen = imageLen;
+    image = (char *)malloc(bufLen);
+    if (NULL == image) {
+      return -1;
+    }
+  }
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    free(image);
+    return -1;
+  }
 
-    if (foundIndex == -1) { // return if not found
-        return;
+  int written = 0;
+  while (written < imageLen) {
+    int ret = (int)write(fd, image + written, imageLen - written);
+    if (ret <= 0) {
+      break;
     }
+    written += ret;
+  }
+
+  close(fd);
+  free(image);
 
-    // shift elements back to replace the removed one
-    for (int i = foundIndex; i < fdEnd; i++) {
-        fileDescriptors[i] = fileDescriptors[i + 1];
+  return (written == imageLen) ? 0 : -1;
+}
+
+
+// load the ramdisk image stored in the file at path
+static int rd_restore_from_file(char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  int imageLen = (int)lseek(fd, 0, SEEK_END);
+  if ((imageLen <= 0) || (lseek(fd, 0, SEEK_SET) != 0)) {
+    close(fd);
+    return -1;
+  }
+
+  char *image = (char *)malloc(imageLen);
+  if (NULL == image) {
+    close(fd);
+    return -1;
+  }
+
+  int readLen = 0;
+  while (readLen < imageLen) {
+    int ret = (int)read(fd, image + readLen, imageLen - readLen);
+    if (ret <= 0) {
+      break;
     }
+    readLen += ret;
+  }
+  close(fd);
+
+  int ret = -1;
+  if (readLen == imageLen) {
+    ret = rd_restore(image, imageLen);
+  }
+  free(image);
+
+  return ret;
+}
+
+
+//file descriptor table, directly indexed by fd - FD_BASE
+//slots live in fixed size chunks so a descriptor never moves when the table grows
+#define FD_BASE 1
+#define FD_CHUNK_SIZE 1024
+
+static struct fileDescriptor **fdChunks = NULL;
+static int fdChunkCount = 0;
+static int fdFreeList = -1;
+static pthread_mutex_t fdTableLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+// return the descriptor in slot index, caller holds fdTableLock
+static struct fileDescriptor *getFDSlot(int index) {
+  return &fdChunks[index / FD_CHUNK_SIZE][index % FD_CHUNK_SIZE];
+}
+
+// add a chunk of free slots to the table, caller holds fdTableLock
+static int growFDTable() {
+  struct fileDescriptor **chunks = (struct fileDescriptor **)realloc(fdChunks, sizeof(struct fileDescriptor *) * (fdChunkCount + 1));
+  if (NULL == chunks) {
+    return -1;
+  }
+  fdChunks = chunks;
+
+  struct fileDescriptor *chunk = (struct fileDescriptor *)calloc(FD_CHUNK_SIZE, sizeof(struct fileDescriptor));
+  if (NULL == chunk) {
+    return -1;
+  }
+  fdChunks[fdChunkCount] = chunk;
+
+  // push new slots in reverse so the lowest fd is handed out first
+  int first = fdChunkCount * FD_CHUNK_SIZE;
+  for (int i = FD_CHUNK_SIZE - 1; i >= 0; i--) {
+    pthread_mutex_init(&chunk[i].lock, NULL);
+    chunk[i].fd = first + i + FD_BASE;
+    chunk[i].nextFree = fdFreeList;
+    fdFreeList = first + i;
+  }
+  fdChunkCount++;
+
+  return 0;
+}
+
+// take a free slot for kernel open file handle, return NULL if out of memory
+static struct fileDescriptor *addToFDTable(int handle) {
+  struct fileDescriptor *fileDescriptor = NULL;
+
+  pthread_mutex_lock(&fdTableLock);
+  if ((-1 != fdFreeList) || (0 == growFDTable())) {
+    fileDescriptor = getFDSlot(fdFreeList);
+    fdFreeList = fileDescriptor->nextFree;
+
+    fileDescriptor->handle = handle;
+    fileDescriptor->position = 0;
+    fileDescriptor->writeBuffer = NULL;
+    fileDescriptor->writeBufferSize = 0;
+    fileDescriptor->writeBufferLen = 0;
+    fileDescriptor->nextFree = -1;
+    fileDescriptor->inUse = 1;
+  }
+  pthread_mutex_unlock(&fdTableLock);
+
+  return fileDescriptor;
+}
+
+// return the slot of fd if it is open, caller holds fdTableLock
+static struct fileDescriptor *openFDSlot(int fd) {
+  int index = fd - FD_BASE;
+
+  if ((index < 0) || (index >= fdChunkCount * FD_CHUNK_SIZE)) {
+    return NULL;
+  }
 
-    fileDescriptors[fdEnd] = emptyDescriptor;
+  struct fileDescriptor *fileDescriptor = getFDSlot(index);
+  if (!fileDescriptor->inUse) {
+    return NULL; // closed or never opened
+  }
 
-    fdEnd--;
+  return fileDescriptor;
 }
 
+// find file descriptor and lock its slot, every non-NULL return must be given back with FDRelease
+// the slot is not recycled while held, so a racing close can't hand it to another open
+static struct fileDescriptor *FDSearch(int fd)
+{
+  pthread_mutex_lock(&fdTableLock);
+  struct fileDescriptor *fileDescriptor = openFDSlot(fd);
+  if (NULL != fileDescriptor) {
+    fileDescriptor->users++;
+  }
+  pthread_mutex_unlock(&fdTableLock);
+
+  if (NULL == fileDescriptor) {
+    return NULL;
+  }
 
+  pthread_mutex_lock(&fileDescriptor->lock);
 
+  // closed while waiting for the slot, its handle is gone
+  pthread_mutex_lock(&fdTableLock);
+  int inUse = fileDescriptor->inUse;
+  pthread_mutex_unlock(&fdTableLock);
+  if (!inUse) {
+    FDRelease(fileDescriptor);
+    return NULL;
+  }
+
+  return fileDescriptor;
+}
+
+// unlock a slot from FDSearch or claimFromFDTable, the last user of a closed slot puts it on the free list
+static void FDRelease(struct fileDescriptor *fileDescriptor) {
+  pthread_mutex_unlock(&fileDescriptor->lock);
+
+  pthread_mutex_lock(&fdTableLock);
+  fileDescriptor->users--;
+  if ((0 == fileDescriptor->users) && !fileDescriptor->inUse) {
+    fileDescriptor->nextFree = fdFreeList;
+    fdFreeList = fileDescriptor->fd - FD_BASE;
+  }
+  pthread_mutex_unlock(&fdTableLock);
+}
+
+// take fd out of the table for closing and lock its slot, NULL if it is not open
+// only one caller can claim an fd, later lookups fail while the close is still running
+static struct fileDescriptor *claimFromFDTable(int fd) {
+  pthread_mutex_lock(&fdTableLock);
+  struct fileDescriptor *fileDescriptor = openFDSlot(fd);
+  if (NULL != fileDescriptor) {
+    fileDescriptor->inUse = 0;
+    fileDescriptor->users++;
+  }
+  pthread_mutex_unlock(&fdTableLock);
+
+  if (NULL != fileDescriptor) {
+    pthread_mutex_lock(&fileDescriptor->lock);
+  }
+
+  return fileDescriptor;
+}
+
+// put a claimed fd back after a close that failed, it stays open, caller still holds the slot
+static void restoreToFDTable(struct fileDescriptor *fileDescriptor) {
+  pthread_mutex_lock(&fdTableLock);
+  fileDescriptor->inUse = 1;
+  pthread_mutex_unlock(&fdTableLock);
+}
 
@@ -0,0 +1,1346 @@
+// benchmarks of the rd_* library calls, built with -DRD_USERSPACE
+//   filesystem_bench          run every benchmark
+//   filesystem_bench NAME...  run the named ones
+// the library in filesystem.c and the module in filesystem_main.c share this one process, each
+// ioctl goes straight to rd_ioctl, so the numbers cover everything but the system call itself
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "filesystem_main.c"
+
+// the library opens /proc/ramdisk around every call, that descriptor is only ever passed to ioctl
+#define BENCH_PROC_FD 1000
+
+static int benchOpen(const char *path, int flags, ...)
+{
+  if (0 == strcmp("/proc/ramdisk", path)) {
+    return BENCH_PROC_FD;
+  }
+
+  va_list args;
+  va_start(args, flags);
+  int mode = va_arg(args, int);
+  va_end(args);
+
+  return open(path, flags, mode);
+}
+
+static int benchClose(int fd)
+{
+  if (BENCH_PROC_FD == fd) {
+    return 0;
+  }
+  return close(fd);
+}
+
+#define open benchOpen
+#define close benchClose
+#define ioctl(fd, cmd, arg) \
+  ((BENCH_PROC_FD == (fd)) ? (int)rd_ioctl(NULL, (cmd), (unsigned long)(arg)) : -1)
+
+#include "filesystem.c"
+
+#undef open
+#undef close
+#undef ioctl
+
+#define BENCH_PATH_LEN 64
+
+static long long nowNs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void report(const char *bench, const char *what, double value, const char *unit)
+{
+  printf("%-10s %-44s %12.1f %s\n", bench, what, value, unit);
+}
+
+// every benchmark starts from a freshly formatted ramdisk
+static void freshRamdisk(void)
+{
+  mutex_lock(&rdLock);
+  if (NULL != ramdisk) {
+    uninitialize();
+  }
+  if (0 != ramdiskInitOperations()) {
+    fprintf(stderr, "out of memory for the ramdisk\n");
+    exit(1);
+  }
+  dedupReset();
+  deferredFreeReset();
+  mutex_unlock(&rdLock);
+}
+
+// ---------------------------------------------------------------------------------------------
+// fdtable: thousands of files open at once, the open, lookup and close cost per descriptor
+
+#define FDTABLE_FILES 256
+#define FDTABLE_OPENS_PER_FILE 15
+#define FDTABLE_FDS (FDTABLE_FILES * FDTABLE_OPENS_PER_FILE)
+#define FDTABLE_LOOKUP_ROUNDS 20
+
+static int benchFDTable(void)
+{
+  static int fds[FDTABLE_FDS];
+  char path[BENCH_PATH_LEN];
+
+  for (int i = 0; i < FDTABLE_FILES; i++) {
+    snprintf(path, sizeof(path), "/f%d", i);
+    if (0 != rd_creat(path)) {
+      return -1;
+    }
+  }
+
+  long long start = nowNs();
+  for (int i = 0; i < FDTABLE_FDS; i++) {
+    snprintf(path, sizeof(path), "/f%d", i % FDTABLE_FILES);
+    fds[i] = rd_open(path);
+    if (fds[i] < 0) {
+      return -1;
+    }
+  }
+  report("fdtable", "rd_open with up to 3840 open",
+         (double)(nowNs() - start) / FDTABLE_FDS, "ns/op");
+
+  // rd_lseek is the cheapest call that goes through FDSearch
+  start = nowNs();
+  for (int round = 0; round < FDTABLE_LOOKUP_ROUNDS; round++) {
+    for (int i = 0; i < FDTABLE_FDS; i++) {
+      if (0 != rd_lseek(fds[i], 0)) {
+        return -1;
+      }
+    }
+  }
+  report("fdtable", "rd_lseek with 3840 open",
+         (double)(nowNs() - start) / (FDTABLE_FDS * FDTABLE_LOOKUP_ROUNDS), "ns/op");
+
+  // close in a shuffled order so the free list is not rebuilt in slot order
+  srand(1);
+  for (int i = FDTABLE_FDS - 1; i > 0; i--) {
+    int j = rand() % (i + 1);
+    int fd = fds[i];
+    fds[i] = fds[j];
+    fds[j] = fd;
+  }
+  start = nowNs();
+  for (int i = 0; i < FDTABLE_FDS; i++) {
+    if (0 != rd_close(fds[i])) {
+      return -1;
+    }
+  }
+  report("fdtable", "rd_close in random order", (double)(nowNs() - start) / FDTABLE_FDS, "ns/op");
+
+  return 0;
+}
+
+// ---------------------------------------------------------------------------------------------
+// seqread: 4KB reads over a file reaching into the double indirect blocks, in file order and in
+// a shuffled order the read-ahead window can't follow
+
+#define SEQREAD_FILE_SIZE (1024 * 1024)
+#define SEQREAD_CHUNK 4096
+#define SEQREAD_CHUNKS (SEQREAD_FILE_SIZE / SEQREAD_CHUNK)
+#define SEQREAD_PASSES 50
+
+static int benchSeqRead(void)
+{
+  static char buf[SEQREAD_CHUNK];
+  int order[SEQREAD_CHUNKS];
+
+  if (0 != rd_creat("/big")) {
+    return -1;
+  }
+  int fd = rd_open("/big");
+  if (fd < 0) {
+    return -1;
+  }
+  for (int i = 0; i < SEQREAD_CHUNKS; i++) {
+    memset(buf, i, sizeof(buf));
+    if (SEQREAD_CHUNK != rd_write(fd, buf, SEQREAD_CHUNK)) {
+      return -1;
+    }
+  }
+
+  long long start = nowNs();
+  for (int pass = 0; pass < SEQREAD_PASSES; pass++) {
+    if (0 != rd_lseek(fd, 0)) {
+      return -1;
+    }
+    for (int i = 0; i < SEQREAD_CHUNKS; i++) {
+      if (SEQREAD_CHUNK != rd_read(fd, buf, SEQREAD_CHUNK)) {
+        return -1;
+      }
+    }
+  }
+  double seconds = (double)(nowNs() - start) / 1e9;
+  report("seqread", "sequential 4KB reads of 1MB", SEQREAD_PASSES / seconds, "MB/s");
+
+  srand(1);
+  for (int i = 0; i < SEQREAD_CHUNKS; i++) {
+    order[i] = i;
+  }
+  for (int i = SEQREAD_CHUNKS - 1; i > 0; i--) {
+    int j = rand() % (i + 1);
+    int chunk = order[i];
+    order[i] = order[j];
+    order[j] = chunk;
+  }
+
+  start = nowNs();
+  for (int pass = 0; pass < SEQREAD_PASSES; pass++) {
+    for (int i = 0; i < SEQREAD_CHUNKS; i++) {
+      if ((0 != rd_lseek(fd, order[i] * SEQREAD_CHUNK)) ||
+          (SEQREAD_CHUNK != rd_read(fd, buf, SEQREAD_CHUNK))) {
+        return -1;
+      }
+    }
+  }
+  seconds = (double)(nowNs() - start) / 1e9;
+  report("seqread", "random order 4KB reads of 1MB", SEQREAD_PASSES / seconds, "MB/s");
+
+  return rd_close(fd);
+}
+
+// ---------------------------------------------------------------------------------------------
+// append: log style appends of 16B to 1KB records, written straight through and through a
+// rd_setwritebuf buffer
+
+#define APPEND_BYTES (256 * 1024)
+#define APPEND_BUFFER_SIZE 4096
+#define APPEND_ROUNDS 16
+
+// append APPEND_BYTES of size byte records to a new file, returns the records per second
+static double appendRecords(int size, int bufferSize)
+{
+  static char record[1024];
+  int count = APPEND_BYTES / size;
+  long long total = 0;
+
+  memset(record, 'r', sizeof(record));
+  for (int round = 0; round < APPEND_ROUNDS; round++) {
+    rd_unlink("/log");
+    if (0 != rd_creat("/log")) {
+      return -1;
+    }
+    int fd = rd_open("/log");
+    if ((fd < 0) || (0 != rd_setwritebuf(fd, bufferSize))) {
+      return -1;
+    }
+
+    long long start = nowNs();
+    for (int i = 0; i < count; i++) {
+      if (size != rd_write(fd, record, size)) {
+        return -1;
+      }
+    }
+    if (0 != rd_close(fd)) {
+      return -1;
+    }
+    total += nowNs() - start;
+  }
+
+  return (double)count * APPEND_ROUNDS / ((double)total / 1e9);
+}
+
+static int benchAppend(void)
+{
+  static const int sizes[] = { 16, 64, 256, 1024 };
+  char what[BENCH_PATH_LEN];
+
+  for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+    double direct = appendRecords(sizes[i], 0);
+    double buffered = appendRecords(sizes[i], APPEND_BUFFER_SIZE);
+    if ((direct < 0) || (buffered < 0)) {
+      return -1;
+    }
+    snprintf(what, sizeof(what), "%dB records unbuffered", sizes[i]);
+    report("append", what, direct / 1000, "K records/s");
+    snprintf(what, sizeof(what), "%dB records with a 4KB write buffer", sizes[i]);
+    report("append", what, buffered / 1000, "K records/s");
+  }
+
+  return 0;
+}
+
+// ---------------------------------------------------------------------------------------------
+// tinyfiles: config sized files that fit inline in the inode next to ones just over the inline
+// capacity, blocks used and the cost of reading one back
+
+#define TINY_FILES 400
+#define TINY_READ_ROUNDS 20
+
+static int freeBlocks(void)
+{
+  struct rd_frag_report fragReport;
+
+  if (0 != rd_fragreport(&fragReport)) {
+    return -1;
+  }
+  return fragReport.freeBlocks;
+}
+
+// create TINY_FILES files of size bytes under dir and read each back TINY_READ_ROUNDS times
+static int tinyFiles(char *dir, int size)
+{
+  char path[BENCH_PATH_LEN];
+  char what[BENCH_PATH_LEN];
+  char data[2 * INODE_INLINE_CAP];
+  int fds[TINY_FILES];
+
+  if (0 != rd_mkdir(dir)) {
+    return -1;
+  }
+  int before = freeBlocks();
+  memset(data, 'c', sizeof(data));
+  for (int i = 0; i < TINY_FILES; i++) {
+    snprintf(path, sizeof(path), "%s/c%d", dir, i);
+    if (0 != rd_creat(path)) {
+      return -1;
+    }
+    int fd = rd_open(path);
+    if ((fd < 0) || (size != rd_write(fd, data, size)) || (0 != rd_close(fd))) {
+      return -1;
+    }
+  }
+  snprintf(what, sizeof(what), "%d files of %dB, blocks used", TINY_FILES, size);
+  report("tinyfiles", what, before - freeBlocks(), "blocks");
+
+  // the files stay open so the timing is the read, not the path lookup of rd_open
+  for (int i = 0; i < TINY_FILES; i++) {
+    snprintf(path, sizeof(path), "%s/c%d", dir, i);
+    fds[i] = rd_open(path);
+    if (fds[i] < 0) {
+      return -1;
+    }
+  }
+  long long start = nowNs();
+  for (int round = 0; round < TINY_READ_ROUNDS; round++) {
+    for (int i = 0; i < TINY_FILES; i++) {
+      if ((0 != rd_lseek(fds[i], 0)) || (size != rd_read(fds[i], data, sizeof(data)))) {
+        return -1;
+      }
+    }
+  }
+  snprintf(what, sizeof(what), "lseek and read of a %dB file", size);
+  report("tinyfiles", what, (double)(nowNs() - start) / (TINY_FILES * TINY_READ_ROUNDS), "ns/op");
+
+  for (int i = 0; i < TINY_FILES; i++) {
+    if (0 != rd_close(fds[i])) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int benchTinyFiles(void)
+{
+  if ((0 != tinyFiles("/inline", 32)) || (0 != tinyFiles("/block", INODE_INLINE_CAP + 8))) {
+    return -1;
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------------------------
+// metadata: create, stat, readdir and unlink over a directory of empty files, the paths that
+// check inode types and touch the hot inode fields, then the inode table scans those paths run
+// on, over the current inode and over the older layout kept below as a baseline
+
+#define METADATA_FILES 500
+#define METADATA_STAT_ROUNDS 20
+#define METADATA_SCAN_ROUNDS 2000
+
+// the inode before it was fitted to a cache line: 60 bytes, so neighbours straddle lines,
+// and a type string compared with strcmp
+struct benchOldINode {
+  char type[4];
+  int size;
+  int location[10];
+  int dirCount;
+  int filesOpen;
+  int flags;
+};
+
+static struct benchOldINode oldINodes[MAX_INODES];
+static struct inode newINodes[MAX_INODES];
+
+// keeps the compiler from hoisting a scan out of the rounds loop, the tables never change
+#define SCAN_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+// every inode used, one in four a directory, the only free one at the end
+static void fillINodeTables(void)
+{
+  for (int i = 0; i < MAX_INODES; i++) {
+    int dir = (0 == i % 4);
+    strcpy(oldINodes[i].type, dir ? "dir" : "reg");
+    oldINodes[i].size = i;
+    newINodes[i].type = dir ? dirINodeType : regINodeType;
+    newINodes[i].size = i;
+  }
+  oldINodes[MAX_INODES - 1].type[0] = '\0';
+  newINodes[MAX_INODES - 1].type = unusedINodeType;
+}
+
+// ns per inode of a type test and size read over the whole table, the way lookups and stat go
+static double typeScanNs(int oldLayout, long long *total)
+{
+  long long start = nowNs();
+  for (int round = 0; round < METADATA_SCAN_ROUNDS; round++) {
+    SCAN_BARRIER();
+    if (oldLayout) {
+      for (int i = 0; i < MAX_INODES; i++) {
+        if (0 == strcmp(oldINodes[i].type, "dir")) {
+          *total += oldINodes[i].size;
+        }
+      }
+    } else {
+      for (int i = 0; i < MAX_INODES; i++) {
+        if (dirINodeType == newINodes[i].type) {
+          *total += newINodes[i].size;
+        }
+      }
+    }
+  }
+  return (double)(nowNs() - start) / ((double)METADATA_SCAN_ROUNDS * MAX_INODES);
+}
+
+// ns per inode passed looking for a free one, the way getAvailableNode goes
+static double freeScanNs(int oldLayout, long long *total)
+{
+  long long start = nowNs();
+  for (int round = 0; round < METADATA_SCAN_ROUNDS; round++) {
+    SCAN_BARRIER();
+    int i = 0;
+    if (oldLayout) {
+      while ((i < MAX_INODES) && ('\0' != oldINodes[i].type[0])) {
+        i++;
+      }
+    } else {
+      while ((i < MAX_INODES) && (unusedINodeType != newINodes[i].type)) {
+        i++;
+      }
+    }
+    *total += i;
+  }
+  return (double)(nowNs() - start) / ((double)METADATA_SCAN_ROUNDS * MAX_INODES);
+}
+
+static int benchMetadata(void)
+{
+  char path[BENCH_PATH_LEN];
+  struct rd_stat stat;
+  struct rd_dirent dirent;
+
+  if (0 != rd_mkdir("/meta")) {
+    return -1;
+  }
+
+  long long start = nowNs();
+  for (int i = 0; i < METADATA_FILES; i++) {
+    snprintf(path, sizeof(path), "/meta/m%d", i);
+    if (0 != rd_creat(path)) {
+      return -1;
+    }
+  }
+  report("metadata", "rd_creat", (double)(nowNs() - start) / METADATA_FILES, "ns/op");
+
+  start = nowNs();
+  for (int round = 0; round < METADATA_STAT_ROUNDS; round++) {
+    for (int i = 0; i < METADATA_FILES; i++) {
+      snprintf(path, sizeof(path), "/meta/m%d", i);
+      if (0 != rd_stat(path, &stat)) {
+        return -1;
+      }
+    }
+  }
+  report("metadata", "rd_stat",
+         (double)(nowNs() - start) / (METADATA_FILES * METADATA_STAT_ROUNDS), "ns/op");
+
+  int entries = 0;
+  start = nowNs();
+  for (int round = 0; round < METADATA_STAT_ROUNDS; round++) {
+    int fd = rd_open("/meta");
+    if (fd < 0) {
+      return -1;
+    }
+    while (rd_readdir(fd, (char *)&dirent) > 0) {
+      entries++;
+    }
+    if (0 != rd_close(fd)) {
+      return -1;
+    }
+  }
+  if (entries != METADATA_FILES * METADATA_STAT_ROUNDS) {
+    return -1;
+  }
+  report("metadata", "rd_readdir per entry", (double)(nowNs() - start) / entries, "ns/op");
+
+  start = nowNs();
+  for (int i = 0; i < METADATA_FILES; i++) {
+    snprintf(path, sizeof(path), "/meta/m%d", i);
+    if (0 != rd_unlink(path)) {
+      return -1;
+    }
+  }
+  report("metadata", "rd_unlink", (double)(nowNs() - start) / METADATA_FILES, "ns/op");
+
+  // both layouts must see the same table
+  long long oldTotal = 0;
+  long long newTotal = 0;
+  fillINodeTables();
+  report("metadata", "type scan, old 60B layout with strcmp", typeScanNs(1, &oldTotal), "ns/inode");
+  report("metadata", "type scan, 64B layout with integer type", typeScanNs(0, &newTotal), "ns/inode");
+  report("metadata", "free inode search, old 60B layout", freeScanNs(1, &oldTotal), "ns/inode");
+  report("metadata", "free inode search, 64B layout", freeScanNs(0, &newTotal), "ns/inode");
+  if (oldTotal != newTotal) {
+    return -1;
+  }
+
+  return 0;
+}
+
+// ---------------------------------------------------------------------------------------------
+// startup: bringing a populated filesystem up from a raw image file with ramdiskInitFromFile,
+// which maps it and faults pages in as they are touched, next to copying it in with rd_restore
+// RD_MEM_CAP fixes the image at 2MB, the image file is in the page cache for every round
+
+#define STARTUP_FILES 200
+#define STARTUP_FILE_SIZE 4096
+#define STARTUP_ROUNDS 200
+
+static int benchStartup(void)
+{
+  static char data[STARTUP_FILE_SIZE];
+  char path[BENCH_PATH_LEN];
+  char imagePath[] = "/tmp/rdbenchXXXXXX";
+  struct rd_stat stat;
+  int imageLen = 0;
+
+  memset(data, 'i', sizeof(data));
+  for (int i = 0; i < STARTUP_FILES; i++) {
+    snprintf(path, sizeof(path), "/s%d", i);
+    int fd = (0 == rd_creat(path)) ? rd_open(path) : -1;
+    if ((fd < 0) || (STARTUP_FILE_SIZE != rd_write(fd, data, STARTUP_FILE_SIZE)) ||
+        (0 != rd_close(fd))) {
+      return -1;
+    }
+  }
+
+  // the same filesystem as a snapshot and as a raw image file
+  rd_snapshot(NULL, 0, &imageLen);
+  char *snapshot = (char *)malloc(imageLen);
+  if ((NULL == snapshot) || (0 != rd_snapshot(snapshot, imageLen, &imageLen))) {
+    free(snapshot);
+    return -1;
+  }
+  int imageFd = mkstemp(imagePath);
+  if ((imageFd < 0) || (RD_MEM_CAP != write(imageFd, ramdisk, RD_MEM_CAP))) {
+    free(snapshot);
+    return -1;
+  }
+  close(imageFd);
+
+  long long initTotal = 0;
+  long long firstStatTotal = 0;
+  int ret = 0;
+  for (int round = 0; (round < STARTUP_ROUNDS) && (0 == ret); round++) {
+    mutex_lock(&rdLock);
+    uninitialize();
+    long long start = nowNs();
+    ret = ramdiskInitFromFile(imagePath);
+    initTotal += nowNs() - start;
+    mutex_unlock(&rdLock);
+
+    start = nowNs();
+    ret |= rd_stat("/s199", &stat);
+    firstStatTotal += nowNs() - start;
+  }
+  if (0 == ret) {
+    report("startup", "ramdiskInitFromFile of a 2MB image",
+           (double)initTotal / STARTUP_ROUNDS / 1000, "us");
+    report("startup", "first rd_stat after mapping",
+           (double)firstStatTotal / STARTUP_ROUNDS / 1000, "us");
+  }
+
+  long long restoreTotal = 0;
+  for (int round = 0; (round < STARTUP_ROUNDS) && (0 == ret); round++) {
+    freshRamdisk();
+    long long start = nowNs();
+    ret = rd_restore(snapshot, imageLen);
+    restoreTotal += nowNs() - start;
+  }
+  if (0 == ret) {
+    snprintf(path, sizeof(path), "rd_restore of a %dKB snapshot", imageLen / 1024);
+    report("startup", path, (double)restoreTotal / STARTUP_ROUNDS / 1000, "us");
+  }
+
+  // back on vmalloc memory before the image goes away
+  freshRamdisk();
+  unlink(imagePath);
+  free(snapshot);
+
+  return ret;
+}
+
+// ---------------------------------------------------------------------------------------------
+// dedup: files built from a handful of template blocks and zero filled runs, written with and
+// without RD_FLAG_DEDUP, the blocks they take and the write throughput
+
+#define DEDUP_FILES 64
+#define DEDUP_FILE_SIZE 8192
+#define DEDUP_CHUNK 4096
+#define DEDUP_TEMPLATES 16
+
+// write the template workload under a new directory with the given flags
+// returns the blocks it took, the nanoseconds spent writing in *elapsed
+static int dedupWorkload(int flags, long long *elapsed)
+{
+  static char chunk[DEDUP_CHUNK];
+  char path[BENCH_PATH_LEN];
+
+  freshRamdisk();
+  if ((0 != rd_mkdir("/d")) || (0 != rd_setflags("/d", flags))) {
+    return -1;
+  }
+  int before = freeBlocks();
+
+  *elapsed = 0;
+  for (int i = 0; i < DEDUP_FILES; i++) {
+    snprintf(path, sizeof(path), "/d/t%d", i);
+    int fd = (0 == rd_creat(path)) ? rd_open(path) : -1;
+    if (fd < 0) {
+      return -1;
+    }
+    for (int offset = 0; offset < DEDUP_FILE_SIZE; offset += DEDUP_CHUNK) {
+      for (int block = 0; block < DEDUP_CHUNK / RD_BLOCK_SIZE; block++) {
+        int blockNumber = (offset + block * RD_BLOCK_SIZE) / RD_BLOCK_SIZE;
+        int template = (0 == blockNumber % 4) ? 0 : 1 + (i * 7 + blockNumber) % DEDUP_TEMPLATES;
+        memset(chunk + block * RD_BLOCK_SIZE, template, RD_BLOCK_SIZE);
+      }
+      long long start = nowNs();
+      int written = rd_write(fd, chunk, DEDUP_CHUNK);
+      *elapsed += nowNs() - start;
+      if (DEDUP_CHUNK != written) {
+        return -1;
+      }
+    }
+    if (0 != rd_close(fd)) {
+      return -1;
+    }
+  }
+
+  return before - freeBlocks();
+}
+
+static int benchDedup(void)
+{
+  long long plainNs = 0;
+  long long dedupNs = 0;
+
+  int plainBlocks = dedupWorkload(0, &plainNs);
+  int dedupBlocks = dedupWorkload(RD_FLAG_DEDUP, &dedupNs);
+  if ((plainBlocks <= 0) || (dedupBlocks <= 0)) {
+    return -1;
+  }
+
+  double megabytes = (double)DEDUP_FILES * DEDUP_FILE_SIZE / (1024 * 1024);
+  report("dedup", "blocks used without dedup", plainBlocks, "blocks");
+  report("dedup", "blocks used with dedup", dedupBlocks, "blocks");
+  report("dedup", "dedup ratio", (double)plainBlocks / dedupBlocks, "x");
+  report("dedup", "4KB writes without dedup", megabytes / ((double)plainNs / 1e9), "MB/s");
+  report("dedup", "4KB writes with dedup", megabytes / ((double)dedupNs / 1e9), "MB/s");
+
+  return 0;
+}
+
+// ---------------------------------------------------------------------------------------------
+// compress: log like text written to, and read back from, a plain and an RD_FLAG_COMPRESS
+// directory, the blocks it takes and the read and write latency
+
+#define COMPRESS_FILES 8
+#define COMPRESS_FILE_SIZE (64 * 1024)
+#define COMPRESS_CHUNK 4096
+#define COMPRESS_WRITES (COMPRESS_FILES * COMPRESS_FILE_SIZE / COMPRESS_CHUNK)
+#define COMPRESS_READ_SIZE 256
+#define COMPRESS_READS 20000
+
+struct compressResult
+{
+  int blocks;
+  double writeNs; // per 4KB write
+  double seqReadNs; // per 4KB read in file order
+  double randomReadNs; // per 256B read at a random offset
+};
+
+static int compressWorkload(int flags, struct compressResult *result)
+{
+  static char text[COMPRESS_FILE_SIZE];
+  char path[BENCH_PATH_LEN];
+  char buf[COMPRESS_CHUNK];
+  int fds[COMPRESS_FILES];
+
+  int len = 0;
+  for (int line = 0; len < COMPRESS_FILE_SIZE; line++) {
+    len += snprintf(text + len, COMPRESS_FILE_SIZE - len,
+                    "request %d served from cache in %d us status ok\n", line, line % 97);
+  }
+
+  freshRamdisk();
+  if ((0 != rd_mkdir("/c")) || (0 != rd_setflags("/c", flags))) {
+    return -1;
+  }
+  int before = freeBlocks();
+
+  long long start = nowNs();
+  for (int i = 0; i < COMPRESS_FILES; i++) {
+    snprintf(path, sizeof(path), "/c/log%d", i);
+    fds[i] = (0 == rd_creat(path)) ? rd_open(path) : -1;
+    if (fds[i] < 0) {
+      return -1;
+    }
+    for (int offset = 0; offset < COMPRESS_FILE_SIZE; offset += COMPRESS_CHUNK) {
+      if (COMPRESS_CHUNK != rd_write(fds[i], text + offset, COMPRESS_CHUNK)) {
+        return -1;
+      }
+    }
+  }
+  result->writeNs = (double)(nowNs() - start) / COMPRESS_WRITES;
+  result->blocks = before - freeBlocks();
+
+  start = nowNs();
+  for (int i = 0; i < COMPRESS_FILES; i++) {
+    if (0 != rd_lseek(fds[i], 0)) {
+      return -1;
+    }
+    for (int offset = 0; offset < COMPRESS_FILE_SIZE; offset += COMPRESS_CHUNK) {
+      if ((COMPRESS_CHUNK != rd_read(fds[i], buf, COMPRESS_CHUNK)) ||
+          (0 != memcmp(buf, text + offset, COMPRESS_CHUNK))) {
+        return -1;
+      }
+    }
+  }
+  result->seqReadNs = (double)(nowNs() - start) / COMPRESS_WRITES;
+
+  srand(1);
+  start = nowNs();
+  for (int i = 0; i < COMPRESS_READS; i++) {
+    int fd = fds[rand() % COMPRESS_FILES];
+    if ((0 != rd_lseek(fd, rand() % (COMPRESS_FILE_SIZE - COMPRESS_READ_SIZE))) ||
+        (COMPRESS_READ_SIZE != rd_read(fd, buf, COMPRESS_READ_SIZE))) {
+      return -1;
+    }
+  }
+  result->randomReadNs = (double)(nowNs() - start) / COMPRESS_READS;
+
+  for (int i = 0; i < COMPRESS_FILES; i++) {
+    if (0 != rd_close(fds[i])) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int benchCompress(void)
+{
+  struct compressResult plain;
+  struct compressResult compressed;
+
+  if ((0 != compressWorkload(0, &plain)) ||
+      (0 != compressWorkload(RD_FLAG_COMPRESS, &compressed))) {
+    return -1;
+  }
+
+  report("compress", "blocks used uncompressed", plain.blocks, "blocks");
+  report("compress", "blocks used compressed", compressed.blocks, "blocks");
+  report("compress", "compression ratio", (double)plain.blocks / compressed.blocks, "x");
+  report("compress", "4KB write uncompressed", plain.writeNs, "ns");
+  report("compress", "4KB write compressed", compressed.writeNs, "ns");
+  report("compress", "sequential 4KB read uncompressed", plain.seqReadNs, "ns");
+  report("compress", "sequential 4KB read compressed", compressed.seqReadNs, "ns");
+  report("compress", "random 256B read uncompressed", plain.randomReadNs, "ns");
+  report("compress", "random 256B read compressed", compressed.randomReadNs, "ns");
+
+  return 0;
+}
+
+// ---------------------------------------------------------------------------------------------
+// deepcreate: bulk creation inside /data/shard7/bucketN by full path and relative to an open
+// handle on the bucket directory, buckets are kept small so the new name check is cheap next to
+// resolving the path
+
+#define DEEPCREATE_BUCKETS 9
+#define DEEPCREATE_FILES 100
+
+static int deepDirs(void)
+{
+  char path[BENCH_PATH_LEN];
+
+  if ((0 != rd_mkdir("/data")) || (0 != rd_mkdir("/data/shard7"))) {
+    return -1;
+  }
+  for (int bucket = 0; bucket < DEEPCREATE_BUCKETS; bucket++) {
+    snprintf(path, sizeof(path), "/data/shard7/bucket%d", bucket);
+    if (0 != rd_mkdir(path)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int benchDeepCreate(void)
+{
+  char path[BENCH_PATH_LEN];
+
+  if (0 != deepDirs()) {
+    return -1;
+  }
+  long long start = nowNs();
+  for (int bucket = 0; bucket < DEEPCREATE_BUCKETS; bucket++) {
+    for (int i = 0; i < DEEPCREATE_FILES; i++) {
+      snprintf(path, sizeof(path), "/data/shard7/bucket%d/obj%d", bucket, i);
+      if (0 != rd_creat(path)) {
+        return -1;
+      }
+    }
+  }
+  report("deepcreate", "rd_creat by full path",
+         (double)(nowNs() - start) / (DEEPCREATE_BUCKETS * DEEPCREATE_FILES), "ns/op");
+
+  freshRamdisk();
+  if (0 != deepDirs()) {
+    return -1;
+  }
+  start = nowNs();
+  for (int bucket = 0; bucket < DEEPCREATE_BUCKETS; bucket++) {
+    snprintf(path, sizeof(path), "/data/shard7/bucket%d", bucket);
+    int dirfd = rd_open(path);
+    if (dirfd < 0) {
+      return -1;
+    }
+    for (int i = 0; i < DEEPCREATE_FILES; i++) {
+      snprintf(path, sizeof(path), "obj%d", i);
+      if (0 != rd_creatat(dirfd, path)) {
+        return -1;
+      }
+    }
+    if (0 != rd_close(dirfd)) {
+      return -1;
+    }
+  }
+  report("deepcreate", "rd_creatat on a bucket handle",
+         (double)(nowNs() - start) / (DEEPCREATE_BUCKETS * DEEPCREATE_FILES), "ns/op");
+
+  return 0;
+}
+
+// ---------------------------------------------------------------------------------------------
+// lookup: rd_stat of existing paths from 1 to 8 reader threads while one writer keeps creating
+// and unlinking files in a neighbouring directory, total lookups per second for each count
+
+#define LOOKUP_FILES 200
+#define LOOKUP_MAX_READERS 8
+#define LOOKUP_RUN_MS 200
+
+static int lookupStop;
+static int lookupFailed;
+
+struct lookupThread
+{
+  unsigned int seed;
+  long long count;
+};
+
+static void *lookupReader(void *arg)
+{
+  struct lookupThread *reader = (struct lookupThread *)arg;
+  char path[BENCH_PATH_LEN];
+  struct rd_stat stat;
+
+  while (!__atomic_load_n(&lookupStop, __ATOMIC_RELAXED)) {
+    snprintf(path, sizeof(path), "/r/f%d", rand_r(&reader->seed) % LOOKUP_FILES);
+    if (0 != rd_stat(path, &stat)) {
+      __atomic_store_n(&lookupFailed, 1, __ATOMIC_RELAXED);
+    }
+    reader->count++;
+  }
+  return NULL;
+}
+
+static void *lookupWriter(void *arg)
+{
+  char path[BENCH_PATH_LEN];
+  int i = 0;
+
+  (void)arg;
+  while (!__atomic_load_n(&lookupStop, __ATOMIC_RELAXED)) {
+    snprintf(path, sizeof(path), "/w/t%d", i % 64);
+    if ((0 != rd_creat(path)) || (0 != rd_unlink(path))) {
+      __atomic_store_n(&lookupFailed, 1, __ATOMIC_RELAXED);
+    }
+    i++;
+  }
+  return NULL;
+}
+
+static int benchLookup(void)
+{
+  char path[BENCH_PATH_LEN];
+  char what[BENCH_PATH_LEN];
+  pthread_t threads[LOOKUP_MAX_READERS];
+  pthread_t writer;
+  struct lookupThread readers[LOOKUP_MAX_READERS];
+
+  if ((0 != rd_mkdir("/r")) || (0 != rd_mkdir("/w"))) {
+    return -1;
+  }
+  for (int i = 0; i < LOOKUP_FILES; i++) {
+    snprintf(path, sizeof(path), "/r/f%d", i);
+    if (0 != rd_creat(path)) {
+      return -1;
+    }
+  }
+
+  for (int readerCount = 1; readerCount <= LOOKUP_MAX_READERS; readerCount *= 2) {
+    lookupStop = 0;
+    lookupFailed = 0;
+    if (0 != pthread_create(&writer, NULL, lookupWriter, NULL)) {
+      return -1;
+    }
+    int started = 0;
+    while (started < readerCount) {
+      readers[started].seed = started;
+      readers[started].count = 0;
+      if (0 != pthread_create(&threads[started], NULL, lookupReader, &readers[started])) {
+        break;
+      }
+      started++;
+    }
+
+    long long start = nowNs();
+    usleep(LOOKUP_RUN_MS * 1000);
+    __atomic_store_n(&lookupStop, 1, __ATOMIC_RELAXED);
+    long long total = 0;
+    for (int i = 0; i < started; i++) {
+      pthread_join(threads[i], NULL);
+      total += readers[i].count;
+    }
+    double seconds = (double)(nowNs() - start) / 1e9;
+    pthread_join(writer, NULL);
+    if ((started != readerCount) || lookupFailed) {
+      return -1;
+    }
+
+    snprintf(what, sizeof(what), "rd_stat, %d readers and a writer", readerCount);
+    report("lookup", what, total / seconds / 1000, "K ops/s");
+  }
+
+  return 0;
+}
+
+// ---------------------------------------------------------------------------------------------
+// readdir: listing a directory where most entries were unlinked while it was held open, so the
+// tombstones stay in place, next to a directory holding only the live entries
+
+#define READDIR_CREATED 900
+#define READDIR_KEEP_EVERY 9
+#define READDIR_LIVE (READDIR_CREATED / READDIR_KEEP_EVERY)
+#define READDIR_LISTINGS 200
+
+// nanoseconds to open, list and close dir, -1 if an entry went missing
+static double listingNs(char *dir)
+{
+  struct rd_dirent dirent;
+  int entries = 0;
+
+  long long start = nowNs();
+  for (int listing = 0; listing < READDIR_LISTINGS; listing++) {
+    int fd = rd_open(dir);
+    if (fd < 0) {
+      return -1;
+    }
+    while (rd_readdir(fd, (char *)&dirent) > 0) {
+      entries++;
+    }
+    if (0 != rd_close(fd)) {
+      return -1;
+    }
+  }
+  if (READDIR_LIVE * READDIR_LISTINGS != entries) {
+    return -1;
+  }
+  return (double)(nowNs() - start) / READDIR_LISTINGS;
+}
+
+static int benchReaddir(void)
+{
+  char path[BENCH_PATH_LEN];
+
+  if ((0 != rd_mkdir("/sparse")) || (0 != rd_mkdir("/dense"))) {
+    return -1;
+  }
+  // held open throughout, an open directory is never compacted
+  int sparseFd = rd_open("/sparse");
+  if (sparseFd < 0) {
+    return -1;
+  }
+
+  for (int i = 0; i < READDIR_CREATED; i++) {
+    snprintf(path, sizeof(path), "/sparse/e%d", i);
+    if (0 != rd_creat(path)) {
+      return -1;
+    }
+  }
+  for (int i = 0; i < READDIR_CREATED; i++) {
+    snprintf(path, sizeof(path), "/sparse/e%d", i);
+    if ((0 != i % READDIR_KEEP_EVERY) && (0 != rd_unlink(path))) {
+      return -1;
+    }
+  }
+  for (int i = 0; i < READDIR_LIVE; i++) {
+    snprintf(path, sizeof(path), "/dense/e%d", i);
+    if (0 != rd_creat(path)) {
+      return -1;
+    }
+  }
+
+  double sparse = listingNs("/sparse");
+  double dense = listingNs("/dense");
+  if ((sparse < 0) || (dense < 0)) {
+    return -1;
+  }
+  report("readdir", "listing 100 live among 800 tombstones", sparse / 1000, "us");
+  report("readdir", "listing 100 live, no tombstones", dense / 1000, "us");
+
+  return rd_close(sparseFd);
+}
+
+// ---------------------------------------------------------------------------------------------
+// bulk: setting up and tearing down a scratch directory of 1000 files, one rd_creat per file
+// against rd_create_many, and a readdir plus rd_unlink walk against rd_rmtree
+// 1000 is as many as the inode table leaves room for
+
+#define BULK_FILES 1000
+
+static int benchBulk(void)
+{
+  static char names[BULK_FILES][RD_MAX_NAME_LEN + 1];
+  static char *namePointers[BULK_FILES];
+  char path[sizeof("/job/") + RD_MAX_NAME_LEN];
+  struct rd_dirent dirent;
+
+  for (int i = 0; i < BULK_FILES; i++) {
+    snprintf(names[i], sizeof(names[i]), "scratch%d", i);
+    namePointers[i] = names[i];
+  }
+
+  if (0 != rd_mkdir("/job")) {
+    return -1;
+  }
+  long long start = nowNs();
+  for (int i = 0; i < BULK_FILES; i++) {
+    snprintf(path, sizeof(path), "/job/%.*s", RD_MAX_NAME_LEN, names[i]);
+    if (0 != rd_creat(path)) {
+      return -1;
+    }
+  }
+  report("bulk", "1000 rd_creat calls", (double)(nowNs() - start) / 1000000, "ms");
+
+  // the client side teardown lists the directory, then unlinks what it found
+  start = nowNs();
+  int fd = rd_open("/job");
+  if (fd < 0) {
+    return -1;
+  }
+  int found = 0;
+  while ((found < BULK_FILES) && (rd_readdir(fd, (char *)&dirent) > 0)) {
+    snprintf(names[found], sizeof(names[found]), "%s", dirent.filename);
+    found++;
+  }
+  if ((0 != rd_close(fd)) || (BULK_FILES != found)) {
+    return -1;
+  }
+  for (int i = 0; i < found; i++) {
+    snprintf(path, sizeof(path), "/job/%.*s", RD_MAX_NAME_LEN, names[i]);
+    if (0 != rd_unlink(path)) {
+      return -1;
+    }
+  }
+  if (0 != rd_unlink("/job")) {
+    return -1;
+  }
+  report("bulk", "rd_readdir and 1001 rd_unlink calls", (double)(nowNs() - start) / 1000000, "ms");
+
+  if (0 != rd_mkdir("/job")) {
+    return -1;
+  }
+  start = nowNs();
+  if (BULK_FILES != rd_create_many("/job", namePointers, BULK_FILES)) {
+    return -1;
+  }
+  report("bulk", "rd_create_many of 1000", (double)(nowNs() - start) / 1000000, "ms");
+
+  start = nowNs();
+  if (0 != rd_rmtree("/job")) {
+    return -1;
+  }
+  report("bulk", "rd_rmtree of 1000", (double)(nowNs() - start) / 1000000, "ms");
+
+  return 0;
+}
+
+// ---------------------------------------------------------------------------------------------
+// unlink: latency percentiles of rd_unlink on files of 1MB, which reach into the double indirect
+// blocks, with their blocks left to the background worker and freed before returning, and on
+// files of one block
+
+#define UNLINK_ROUNDS 200
+#define UNLINK_CHUNK 4096
+
+static int compareNs(const void *a, const void *b)
+{
+  long long x = *(const long long *)a;
+  long long y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+// sorts samples, then reports their median, 99th percentile and maximum in microseconds
+static void reportPercentiles(const char *bench, const char *what, long long *samples, int count)
+{
+  char line[BENCH_PATH_LEN];
+
+  qsort(samples, count, sizeof(samples[0]), compareNs);
+  snprintf(line, sizeof(line), "%s p50", what);
+  report(bench, line, (double)samples[count / 2] / 1000, "us");
+  snprintf(line, sizeof(line), "%s p99", what);
+  report(bench, line, (double)samples[(count * 99) / 100] / 1000, "us");
+  snprintf(line, sizeof(line), "%s max", what);
+  report(bench, line, (double)samples[count - 1] / 1000, "us");
+}
+
+// time UNLINK_ROUNDS unlinks of a freshly written file of size bytes, with reclaimInline the
+// blocks are freed before the clock stops, the way a synchronous unlink would
+static int unlinkLatency(int size, int reclaimInline, long long *samples)
+{
+  static char chunk[UNLINK_CHUNK];
+
+  memset(chunk, 'u', sizeof(chunk));
+  for (int round = 0; round < UNLINK_ROUNDS; round++) {
+    int fd = (0 == rd_creat("/victim")) ? rd_open("/victim") : -1;
+    if (fd < 0) {
+      return -1;
+    }
+    for (int written = 0; written < size; written += UNLINK_CHUNK) {
+      int len = (size - written < UNLINK_CHUNK) ? size - written : UNLINK_CHUNK;
+      if (len != rd_write(fd, chunk, len)) {
+        return -1;
+      }
+    }
+    if (0 != rd_close(fd)) {
+      return -1;
+    }
+
+    long long start = nowNs();
+    int ret = rd_unlink("/victim");
+    if (reclaimInline) {
+      mutex_lock(&rdLock);
+      reclaimAllDeferredBlocks();
+      mutex_unlock(&rdLock);
+    }
+    samples[round] = nowNs() - start;
+    if (0 != ret) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int benchUnlink(void)
+{
+  static long long samples[UNLINK_ROUNDS];
+
+  if (0 != unlinkLatency(1024 * 1024, 0, samples)) {
+    return -1;
+  }
+  reportPercentiles("unlink", "rd_unlink of 1MB", samples, UNLINK_ROUNDS);
+
+  if (0 != unlinkLatency(1024 * 1024, 1, samples)) {
+    return -1;
+  }
+  reportPercentiles("unlink", "rd_unlink of 1MB freeing inline", samples, UNLINK_ROUNDS);
+
+  if (0 != unlinkLatency(RD_BLOCK_SIZE, 0, samples)) {
+    return -1;
+  }
+  reportPercentiles("unlink", "rd_unlink of 256B", samples, UNLINK_ROUNDS);
+
+  return 0;
+}
+
+// ---------------------------------------------------------------------------------------------
+// defrag: sequential read throughput of a file written a block at a time in step with another
+// one, which is then unlinked, before and after rd_defrag moves it into one run
+
+#define DEFRAG_FILE_SIZE (256 * 1024)
+#define DEFRAG_CHUNK 4096
+#define DEFRAG_PASSES 200
+
+// each block of the file is filled with a byte of its own, never zero so no block becomes a hole
+#define DEFRAG_BLOCK_FILL(offset) ((char)(1 + ((offset) / RD_BLOCK_SIZE) % 127))
+
+// MB/s of 4KB reads over the whole of the open file fd
+static double defragReadMBs(int fd)
+{
+  static char buf[DEFRAG_CHUNK];
+
+  long long start = nowNs();
+  for (int pass = 0; pass < DEFRAG_PASSES; pass++) {
+    if (0 != rd_lseek(fd, 0)) {
+      return -1;
+    }
+    for (int offset = 0; offset < DEFRAG_FILE_SIZE; offset += DEFRAG_CHUNK) {
+      if (DEFRAG_CHUNK != rd_read(fd, buf, DEFRAG_CHUNK)) {
+        return -1;
+      }
+    }
+  }
+  double seconds = (double)(nowNs() - start) / 1e9;
+  return (double)DEFRAG_PASSES * DEFRAG_FILE_SIZE / (1024 * 1024) / seconds;
+}
+
+static int benchDefrag(void)
+{
+  char block[RD_BLOCK_SIZE];
+  struct rd_stat stat;
+
+  if ((0 != rd_creat("/frag")) || (0 != rd_creat("/filler"))) {
+    return -1;
+  }
+  int fd = rd_open("/frag");
+  int fillerFd = rd_open("/filler");
+  if ((fd < 0) || (fillerFd < 0)) {
+    return -1;
+  }
+  for (int offset = 0; offset < DEFRAG_FILE_SIZE; offset += RD_BLOCK_SIZE) {
+    memset(block, DEFRAG_BLOCK_FILL(offset), sizeof(block));
+    if ((RD_BLOCK_SIZE != rd_write(fd, block, RD_BLOCK_SIZE)) ||
+        (RD_BLOCK_SIZE != rd_write(fillerFd, block, RD_BLOCK_SIZE))) {
+      return -1;
+    }
+  }
+  if ((0 != rd_close(fillerFd)) || (0 != rd_unlink("/filler"))) {
+    return -1;
+  }
+
+  if (0 != rd_stat("/frag", &stat)) {
+    return -1;
+  }
+  report("defrag", "extents before rd_defrag", stat.extents, "extents");
+  double before = defragReadMBs(fd);
+
+  long long start = nowNs();
+  if (0 != rd_defrag("/frag")) {
+    return -1;
+  }
+  double defragUs = (double)(nowNs() - start) / 1000;
+
+  if (0 != rd_stat("/frag", &stat)) {
+    return -1;
+  }
+  report("defrag", "extents after rd_defrag", stat.extents, "extents");
+
+  // the moved blocks must still hold the file in order
+  if (0 != rd_lseek(fd, 0)) {
+    return -1;
+  }
+  for (int offset = 0; offset < DEFRAG_FILE_SIZE; offset += RD_BLOCK_SIZE) {
+    if ((RD_BLOCK_SIZE != rd_read(fd, block, RD_BLOCK_SIZE)) ||
+        (DEFRAG_BLOCK_FILL(offset) != block[0]) ||
+        (DEFRAG_BLOCK_FILL(offset) != block[RD_BLOCK_SIZE - 1])) {
+      return -1;
+    }
+  }
+  double after = defragReadMBs(fd);
+  if ((before < 0) || (after < 0)) {
+    return -1;
+  }
+  report("defrag", "rd_defrag of 256KB", defragUs, "us");
+  report("defrag", "sequential 4KB reads before", before, "MB/s");
+  report("defrag", "sequential 4KB reads after", after, "MB/s");
+
+  return rd_close(fd);
+}
+
+// ---------------------------------------------------------------------------------------------
+
+struct benchmark
+{
+  const char *name;
+  int (*run)(void);
+};
+
+static const struct benchmark benchmarks[] = {
+  { "fdtable", benchFDTable },
+  { "seqread", benchSeqRead },
+  { "append", benchAppend },
+  { "tinyfiles", benchTinyFiles },
+  { "metadata", benchMetadata },
+  { "startup", benchStartup },
+  { "dedup", benchDedup },
+  { "compress", benchCompress },
+  { "deepcreate", benchDeepCreate },
+  { "lookup", benchLookup },
+  { "readdir", benchReaddir },
+  { "bulk", benchBulk },
+  { "unlink", benchUnlink },
+  { "defrag", benchDefrag },
+};
+
+#define BENCHMARK_COUNT ((int)(sizeof(benchmarks) / sizeof(benchmarks[0])))
+
+static int runBenchmark(const struct benchmark *benchmark)
+{
+  freshRamdisk();
+  if (0 != benchmark->run()) {
+    fprintf(stderr, "%s: failed\n", benchmark->name);
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  int ret = 0;
+
+  seqcount_mutex_init(&rdNamespaceSeq, &rdLock);
+
+  if (1 == argc) {
+    for (int i = 0; i < BENCHMARK_COUNT; i++) {
+      ret |= runBenchmark(&benchmarks[i]);
+    }
+    return (0 == ret) ? 0 : 1;
+  }
+
+  for (int arg = 1; arg < argc; arg++) {
+    int i = 0;
+    while ((i < BENCHMARK_COUNT) && (0 != strcmp(argv[arg], benchmarks[i].name))) {
+      i++;
+    }
+    if (BENCHMARK_COUNT == i) {
+      fprintf(stderr, "unknown benchmark %s\n", argv[arg]);
+      return 1;
+    }
+    ret |= runBenchmark(&benchmarks[i]);
+  }
+
+  return (0 == ret) ? 0 : 1;
+}
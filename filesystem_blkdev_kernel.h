@@ -0,0 +1,129 @@
+#ifndef _FILESYSTEM_BLKDEV_KERNEL_H
+#define _FILESYSTEM_BLKDEV_KERNEL_H
+
+// raw block device view of the ramdisk memory, /dev/rdblk, next to the ioctl file API
+// blk-mq with one hardware queue per online cpu, requests are served on the queue they were
+// issued to with no lock in between, the raw baseline the rd_* calls are measured against
+
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/genhd.h>
+#include <linux/highmem.h>
+#include <linux/cpumask.h>
+
+#define RD_BLKDEV_NAME "rdblk"
+#define RD_SECTOR_SHIFT 9
+
+// requests in flight per hardware queue
+#define RD_BLKDEV_QUEUE_DEPTH 128
+
+static int rdBlkdevMajor;
+static struct blk_mq_tag_set rdTagSet;
+static struct request_queue *rdQueue;
+static struct gendisk *rdDisk;
+
+static const struct block_device_operations rdBlkdevOps = {
+  .owner = THIS_MODULE,
+};
+
+// copy one request segment from the ramdisk at byte offset pos into its page
+static void rdBlkdevRead(struct bio_vec *bvec, loff_t pos)
+{
+  char *page = (char *)kmap_atomic(bvec->bv_page);
+  memcpy(page + bvec->bv_offset, ramdisk + pos, bvec->bv_len);
+  kunmap_atomic(page);
+  flush_dcache_page(bvec->bv_page);
+}
+
+// serve a request straight from the ramdisk memory
+// the device is read only, writes would land under the filesystem the ioctls manage without rdLock
+static blk_status_t rdBlkdevQueueRq(struct blk_mq_hw_ctx *hctx, const struct blk_mq_queue_data *bd)
+{
+  struct request *rq = bd->rq;
+  loff_t pos = (loff_t)blk_rq_pos(rq) << RD_SECTOR_SHIFT;
+  struct req_iterator iter;
+  struct bio_vec bvec;
+
+  blk_mq_start_request(rq);
+
+  // error check: reads inside the ramdisk only
+  if ((REQ_OP_READ != req_op(rq)) || ((pos + blk_rq_bytes(rq)) > RD_MEM_CAP)) {
+    blk_mq_end_request(rq, BLK_STS_IOERR);
+    return BLK_STS_OK;
+  }
+
+  rq_for_each_segment(bvec, rq, iter) {
+    rdBlkdevRead(&bvec, pos);
+    pos = pos + bvec.bv_len;
+  }
+  blk_mq_end_request(rq, BLK_STS_OK);
+
+  return BLK_STS_OK;
+}
+
+static const struct blk_mq_ops rdBlkdevMqOps = {
+  .queue_rq = rdBlkdevQueueRq,
+};
+
+// register /dev/rdblk over the ramdisk ramdiskInitOperations set up, returns -1 on failure
+// with nothing left registered
+static int rdBlkdevInit(void)
+{
+  rdBlkdevMajor = register_blkdev(0, RD_BLKDEV_NAME);
+  if (rdBlkdevMajor <= 0) {
+    return -1;
+  }
+
+  memset(&rdTagSet, 0, sizeof(rdTagSet));
+  rdTagSet.ops = &rdBlkdevMqOps;
+  rdTagSet.nr_hw_queues = num_online_cpus();
+  rdTagSet.queue_depth = RD_BLKDEV_QUEUE_DEPTH;
+  rdTagSet.numa_node = NUMA_NO_NODE;
+  rdTagSet.flags = BLK_MQ_F_SHOULD_MERGE;
+  if (0 != blk_mq_alloc_tag_set(&rdTagSet)) {
+    unregister_blkdev(rdBlkdevMajor, RD_BLKDEV_NAME);
+    return -1;
+  }
+
+  rdQueue = blk_mq_init_queue(&rdTagSet);
+  if (IS_ERR(rdQueue)) {
+    rdQueue = NULL;
+    blk_mq_free_tag_set(&rdTagSet);
+    unregister_blkdev(rdBlkdevMajor, RD_BLKDEV_NAME);
+    return -1;
+  }
+
+  rdDisk = alloc_disk(1);
+  if (NULL == rdDisk) {
+    blk_cleanup_queue(rdQueue);
+    blk_mq_free_tag_set(&rdTagSet);
+    unregister_blkdev(rdBlkdevMajor, RD_BLKDEV_NAME);
+    return -1;
+  }
+  rdDisk->major = rdBlkdevMajor;
+  rdDisk->first_minor = 0;
+  rdDisk->fops = &rdBlkdevOps;
+  rdDisk->queue = rdQueue;
+  snprintf(rdDisk->disk_name, sizeof(rdDisk->disk_name), RD_BLKDEV_NAME);
+  set_capacity(rdDisk, RD_MEM_CAP >> RD_SECTOR_SHIFT);
+  set_disk_ro(rdDisk, 1);
+  add_disk(rdDisk);
+
+  return 0;
+}
+
+// take /dev/rdblk down, before the ramdisk memory goes
+static void rdBlkdevExit(void)
+{
+  if (NULL == rdDisk) {
+    return;
+  }
+  del_gendisk(rdDisk);
+  blk_cleanup_queue(rdQueue);
+  put_disk(rdDisk);
+  blk_mq_free_tag_set(&rdTagSet);
+  unregister_blkdev(rdBlkdevMajor, RD_BLKDEV_NAME);
+  rdDisk = NULL;
+}
+
+#endif
@@ -1,17 +1,23 @@
 #include "filesystem_kernel.c"
 
-// kernel function to create file
-static int rd_creat_kernel(char *path) {
-  struct inode *parent_inode = getDirIndexNode(path);
+static int addFileToDir(struct inode *parent_inode, const char *filename, int reuseSlot);
 
-  // error check: If directory does not exist
-  if (parent_inode == NULL) {
+// create regular file filename in directory parent_inode
+static int creatInDir(struct inode *parent_inode, const char *filename) {
+  // error check: check if the path specified by the user already exists
+  if (getDirectory(parent_inode, filename, NULL) != NULL) {
     return -1;
   }
 
-  // error check: check if the path specified by the user already exists
-  const char *filename = UsingPathGetFileName(path);
-  if (getDirectory(parent_inode, filename, NULL) != NULL) {
+  return addFileToDir(parent_inode, filename, 1);
+}
+
+// create regular file filename in directory parent_inode, the caller made sure the name is not taken
+// reuseSlot 0 appends its entry without looking for an empty slot
+static int addFileToDir(struct inode *parent_inode, const char *filename, int reuseSlot) {
+  // error check: name must fit a directory entry
+  int nameLen = strlen(filename);
+  if ((0 == nameLen) || (nameLen > RD_MAX_NAME_LEN)) {
     return -1;
   }
 
@@ -23,25 +29,38 @@ static int rd_creat_kernel(char *path) {
 
   // initialize the new index node
   struct inode *indexNode = getINode(inodeNum);
-  memset(indexNode, 0, sizeof(struct inode));
-  strcpy(indexNode->type, "reg");
+  resetINode(indexNode);
+  indexNode->type = regINodeType;
+  indexNode->linkCount = 1;
+  indexNode->flags = INODE_INLINE_DATA; // contents start out inside the inode
+  indexNode->flags |= parent_inode->flags & INODE_USER_FLAGS;
 
   // create and update directory entry
-  struct directory_entry entry;
-  strcpy(entry.filename, filename);
-  entry.inodeNum = inodeNum;
-  if (addToParentDir(parent_inode, &entry) != 0) {
+  if (addDirEntry(parent_inode, filename, inodeNum, reuseSlot) != 0) {
+    releaseINode(indexNode);
     return -1;
   }
 
   return 0;
 }
 
-// create directory
-static int rd_mkdir_kernel(char *path)
+// kernel function to create file, relative paths start at directory dirNum
+static int rd_creat_at(int dirNum, char *path) {
+  struct inode *parent_inode = getDirIndexNodeAt(getINode(dirNum), path);
+
+  // error check: If directory does not exist
+  if (parent_inode == NULL) {
+    return -1;
+  }
+
+  return creatInDir(parent_inode, UsingPathGetFileName(path));
+}
+
+// create directory, relative paths start at directory dirNum
+static int rd_mkdir_at(int dirNum, char *path)
 {
   // error check if parent directory exists
-  struct inode *parent_inode = getDirIndexNode(path);
+  struct inode *parent_inode = getDirIndexNodeAt(getINode(dirNum), path);
   if (NULL == parent_inode) {
     return -1;
   }
@@ -50,6 +69,11 @@ static int rd_mkdir_kernel(char *path)
   if (NULL != getDirectory(parent_inode, directory_name, NULL)) {
     return -1;
   }
+  // error check name must fit a directory entry
+  int nameLen = strlen(directory_name);
+  if ((0 == nameLen) || (nameLen > RD_MAX_NAME_LEN)) {
+    return -1;
+  }
   // error check for any available nodes
   int inodeNum = getAvailableNode();
   if (-1 == inodeNum) {
@@ -57,13 +81,15 @@ static int rd_mkdir_kernel(char *path)
   }
   // initialize directory node
   struct inode *indexNode = getINode(inodeNum);
-  memset(indexNode, 0, sizeof(struct inode));
-  strcpy(indexNode->type, "dir");
+  resetINode(indexNode);
+  indexNode->type = dirINodeType;
+  indexNode->linkCount = 1;
+  indexNode->flags = INODE_INLINE_DATA; // empty directory takes no blocks
+  indexNode->flags |= parent_inode->flags & INODE_USER_FLAGS;
 
-  struct directory_entry entry;
-  strcpy(entry.filename, directory_name); // update parent directory file for new entry
-  entry.inodeNum = inodeNum;
-  if (0 != addToParentDir(parent_inode, &entry)) {
+  // update parent directory file for new entry
+  if (0 != addToParentDir(parent_inode, directory_name, inodeNum)) {
+    releaseINode(indexNode);
     return -1;
   }
 
@@ -71,19 +97,21 @@ static int rd_mkdir_kernel(char *path)
 }
 
 
-// open file at path
-static int rd_open_kernel(char *path, int *inodeNum) {
-  // error check if root directory
+// open file at path, handle receives the open file, relative paths start at directory dirNum
+static int rd_open_at(int dirNum, char *path, int *handle) {
+  // error check if root directory, an empty path is the start directory itself
   if ((0 == strcmp("/", path)) || (0 == strcmp("", path))) {
-    *inodeNum = 0;
-    struct super_block *superblock = (superblock *)ramdisk;
-    superblock->first.filesOpen++;
-    *inodeNum = 0;
+    int inodeNum = (0 == strcmp("/", path)) ? 0 : dirNum;
+    *handle = allocateOpenFile(inodeNum);
+    if (-1 == *handle) {
+      return -1;
+    }
+    getINode(inodeNum)->filesOpen++;
     return 0;
   }
 
   // error check: if parent directory exists
-  struct inode *parent_inode = getDirIndexNode(path);
+  struct inode *parent_inode = getDirIndexNodeAt(getINode(dirNum), path);
   if (NULL == parent_inode) {
     return -1;
   }
@@ -95,8 +123,11 @@ static int rd_open_kernel(char *path, int *inodeNum) {
     return -1;
   }
 
-  // assign node number & update vars
-  *inodeNum = entry->inodeNum;
+  // take an open file for the node & update vars
+  *handle = allocateOpenFile(entry->inodeNum);
+  if (-1 == *handle) {
+    return -1;
+  }
   struct inode *indexNode = getINode(entry->inodeNum);
   indexNode->filesOpen++;
 
@@ -104,106 +135,246 @@ static int rd_open_kernel(char *path, int *inodeNum) {
 }
 
 
-// close file at fd
-static int rd_close_kernel(int inodeNum) {
-  struct inode *indexNode = NULL; // set to null, update vars
-  indexNode = getINode(inodeNum);
-  indexNode->filesOpen--;
+// close open file at handle
+static int rd_close_kernel(int handle) {
+  struct open_file *openFile = getOpenFile(handle);
+  if (NULL == openFile) {
+    return -1;
+  }
+  openFile->indexNode->filesOpen--;
+  freeOpenFile(handle);
 
   return 0;
 }
 
-// read bytes of the file at fd, into the specified address
-static int rd_read_kernel(int inodeNum, int pos, char *address, int numBytes)
+// read numBytes of a compressed file at the open file position a chunk at a time
+static int readCompressed(struct open_file *openFile, char *address, int numBytes)
+{
+  struct inode *indexNode = openFile->indexNode;
+  int pos = openFile->filePosition.filePosition;
+  int readDataLen = 0;
+
+  while (readDataLen < numBytes) {
+    int offset = pos % COMPRESS_CHUNK_SIZE;
+    int currReadDataLen = COMPRESS_CHUNK_SIZE - offset;
+    if (currReadDataLen > numBytes - readDataLen) {
+      currReadDataLen = numBytes - readDataLen;
+    }
+    if (0 != loadChunk(indexNode, pos / COMPRESS_CHUNK_SIZE, chunkData)) {
+      break;
+    }
+    copy_to_user(address + readDataLen, chunkData + offset, currReadDataLen); // copy from ramdisk to user
+    readDataLen = readDataLen + currReadDataLen;
+    pos = pos + currReadDataLen;
+  }
+  initFilePosn(&openFile->filePosition, indexNode, pos, 1);
+
+  return readDataLen;
+}
+
+// write numBytes from kernel memory at address to a compressed file at pos, or zeros if address is NULL
+// every touched chunk is recompressed whole, returns the bytes written
+static int writeCompressed(struct inode *indexNode, int pos, char *address, int numBytes)
+{
+  int dataWrittenLen = 0;
+
+  while (dataWrittenLen < numBytes) {
+    int chunk = pos / COMPRESS_CHUNK_SIZE;
+    int chunkStart = chunk * COMPRESS_CHUNK_SIZE;
+    int offset = pos - chunkStart;
+    int currWriteDataLen = COMPRESS_CHUNK_SIZE - offset;
+    if (currWriteDataLen > numBytes - dataWrittenLen) {
+      currWriteDataLen = numBytes - dataWrittenLen;
+    }
+
+    // keep what the write doesn't cover
+    if ((COMPRESS_CHUNK_SIZE != currWriteDataLen) && (chunkStart < indexNode->size)) {
+      if (0 != loadChunk(indexNode, chunk, chunkData)) {
+        break;
+      }
+    } else {
+      memset(chunkData, 0, COMPRESS_CHUNK_SIZE);
+    }
+    if (NULL == address) {
+      memset(chunkData + offset, 0, currWriteDataLen);
+    } else {
+      memcpy(chunkData + offset, address + dataWrittenLen, currWriteDataLen);
+    }
+
+    int end = (pos + currWriteDataLen > indexNode->size) ? (pos + currWriteDataLen) : indexNode->size;
+    int rawLen = (end - chunkStart > COMPRESS_CHUNK_SIZE) ? COMPRESS_CHUNK_SIZE : (end - chunkStart);
+    if (0 != storeChunk(indexNode, chunk, chunkData, rawLen, 1)) {
+      // no space left to write
+      break;
+    }
+    dataWrittenLen = dataWrittenLen + currWriteDataLen;
+    pos = pos + currWriteDataLen;
+    indexNode->size = (pos > indexNode->size) ? pos : indexNode->size;
+  }
+
+  return dataWrittenLen;
+}
+
+// read bytes at the open file position into the specified address, newPos receives the position after
+static int rd_read_kernel(int handle, char *address, int numBytes, int *newPos)
 {
+  struct open_file *openFile = getOpenFile(handle);
+  if (NULL == openFile) {
+    return -1;
+  }
+
   // error check, if node is a directory
-  struct inode *indexNode = getINode(inodeNum);
-  if (0 != strcmp("reg", indexNode->type)) { return -1; }
-  struct file_posn filePosition;
-  
+  struct inode *indexNode = openFile->indexNode;
+  if (regINodeType != indexNode->type) { return -1; }
+
+  // resume from the cached position, block pointer included
+  struct file_posn *filePosition = &openFile->filePosition;
+  filePosition->blockPointer.readOnly = 1;
+  int pos = filePosition->filePosition;
+
   if (indexNode->size-pos < numBytes) { // check if byte num is greater than file size
-    num bytes = indexNode->size-pos;
+    numBytes = indexNode->size-pos;
   }
-  initFilePosn(&filePosition, indexNode, pos, 1);
+
+  // compressed files go through the decompression cache instead of block by block
+  if ((indexNode->flags & INODE_COMPRESS) && !(indexNode->flags & INODE_INLINE_DATA)) {
+    int readDataLen = readCompressed(openFile, address, numBytes);
+    *newPos = filePosition->filePosition;
+    return readDataLen;
+  }
+
+  // reads picking up where the last one stopped go through the read-ahead window
+  if (pos == openFile->nextSeqPosition) {
+    openFile->seqReads++;
+  } else {
+    openFile->seqReads = 0;
+  }
+  int readAhead = (openFile->seqReads >= SEQ_READ_THRESHOLD) && !(indexNode->flags & INODE_INLINE_DATA);
+
   char *availablePosn = address;
   int readDataRemainderLen = numBytes;
 
   int readDataLen = 0;
   int currReadDataLen = 0;
   while (readDataRemainderLen > 0) { // read data by the block
-    int blockDataRemainderLen = BLOCK_SIZE - filePosition.dataBlockOffset;
+    int blockDataRemainderLen = BLOCK_SIZE - filePosition->dataBlockOffset;
     if (blockDataRemainderLen < readDataRemainderLen) {
       currReadDataLen = blockDataRemainderLen;
     } else {
       currReadDataLen = readDataRemainderLen;
     }
-    char *src = getMemAddress(&filePosition);
+    char *src = readAhead ? getReadAheadAddress(openFile) : getMemAddress(filePosition);
     if (NULL == src) {
-      break;
+      clear_user(availablePosn, currReadDataLen); // unallocated block inside the file, a hole
+    } else {
+      copy_to_user(availablePosn, src, currReadDataLen); // copy from ramdisk to user
     }
-
-    copy_to_user(availablePosn, src, currReadDataLen); // copy from ramdisk to user
     readDataLen = readDataLen + currReadDataLen;
     availablePosn = availablePosn + currReadDataLen;
     readDataRemainderLen = readDataRemainderLen - currReadDataLen;
-    filePosnAdjust(&filePosition, currReadDataLen);
+    filePosnAdjust(filePosition, currReadDataLen);
   }
+  openFile->nextSeqPosition = filePosition->filePosition;
+  *newPos = filePosition->filePosition;
 
   return readDataLen;
 }
 
-// write from address to file, up to the numBytes
-static int rd_write_kernel(int inodeNum, int pos, char *address, int numBytes)
+// write from address at the open file position, up to the numBytes, newPos receives the position after
+// address is kernel memory, the ioctl layer copies user data in before calling here
+static int rd_write_kernel(int handle, char *address, int numBytes, int *newPos)
 {
+  struct open_file *openFile = getOpenFile(handle);
+  if (NULL == openFile) {
+    return -1;
+  }
 
   //error check if node is a directory
-  struct inode *indexNode = getINode(inodeNum);
-  if (0 != strcmp("reg", indexNode->type)) {
+  struct inode *indexNode = openFile->indexNode;
+  if (regINodeType != indexNode->type) {
     return -1;
   }
 
+  // resume from the cached position, block pointer included
+  struct file_posn *filePosition = &openFile->filePosition;
+  filePosition->blockPointer.readOnly = 0;
+  int pos = filePosition->filePosition;
+
   if (MAX_FILE_SIZE - pos < numBytes) { // calculations of partition
     numBytes = MAX_FILE_SIZE - pos;
   }
-  struct file_posn filePosition;
-  if (numBytes > 0) {
-    initFilePosn(&filePosition, indexNode, pos, 0); // initialize file position
+
+  // tiny files live inside the inode until a write outgrows it
+  if (indexNode->flags & INODE_INLINE_DATA) {
+    if ((pos + numBytes) <= INODE_INLINE_CAP) {
+      if (numBytes > 0) {
+        memcpy(indexNode->inlineData + pos, address, numBytes);
+        filePosnAdjust(filePosition, numBytes);
+      }
+      indexNode->size = (pos + numBytes > indexNode->size) ? (pos + numBytes) : indexNode->size;
+      *newPos = filePosition->filePosition;
+      return (numBytes > 0) ? numBytes : 0;
+    }
+    if (0 != migrateInlineData(indexNode)) {
+      return -1;
+    }
   }
+
+  // the migrated block is a raw chunk, which compressed files read as well
+  if (indexNode->flags & INODE_COMPRESS) {
+    int dataWrittenLen = writeCompressed(indexNode, pos, address, numBytes);
+    initFilePosn(filePosition, indexNode, pos + dataWrittenLen, 0);
+    *newPos = filePosition->filePosition;
+    return dataWrittenLen;
+  }
+
   char *src = address;
   int writeDataRemainderLen = numBytes;
   int dataWrittenLen = 0;
   int currWriteDataRemain = 0;
 
   while (writeDataRemainderLen > 0) { // read data by block
-    int blkSpaceRemaining = BLOCK_SIZE - filePosition.dataBlockOffset;
+    int blkSpaceRemaining = BLOCK_SIZE - filePosition->dataBlockOffset;
     if (blkSpaceRemaining < writeDataRemainderLen) {
       currWriteDataRemain = blkSpaceRemaining;
     } else {
       currWriteDataRemain = writeDataRemainderLen;
     }
-    char *availablePosn = getMemAddress(&filePosition);
-    if (NULL == availablePosn) {
-      // no space left to write
-      break;
+    // whole blocks are checked for zeros, and matched against the dedup index, before landing anywhere
+    if (BLOCK_SIZE == currWriteDataRemain) {
+      if (0 != writeFullBlock(&filePosition->blockPointer, src, indexNode->flags & INODE_DEDUP)) {
+        // no space left to write
+        break;
+      }
+    } else {
+      char *availablePosn = getMemAddress(filePosition);
+      if (NULL == availablePosn) {
+        // no space left to write
+        break;
+      }
+      memcpy(availablePosn, src, currWriteDataRemain);
     }
-    copy_from_user(availablePosn, src, currWriteDataRemain); // copy from user to kernel
     dataWrittenLen = dataWrittenLen + currWriteDataRemain;
     src = src + currWriteDataRemain;
     writeDataRemainderLen = writeDataRemainderLen - currWriteDataRemain;
-    if (writeDataRemainderLen > 0) {
-      filePosnAdjust(&filePosition, currWriteDataRemain);
-    }
+    filePosnAdjust(filePosition, currWriteDataRemain);
   }
   indexNode->size = (pos + dataWrittenLen > indexNode->size) ? (pos + dataWrittenLen) : indexNode->size;
+  *newPos = filePosition->filePosition;
 
   return dataWrittenLen;
 }
 
-// set file position to offset, return new position
-static int rd_lseek_kernel(int inodeNum, int offset, int *offset_toReturn) {
+// set open file position to offset, return new position
+static int rd_lseek_kernel(int handle, int offset, int *offset_toReturn) {
+  struct open_file *openFile = getOpenFile(handle);
+  if (NULL == openFile) {
+    return -1;
+  }
+
   // error check: if directory
-  struct inode *indexNode = getINode(inodeNum);
-  if (0 != strcmp("reg", indexNode->type)) {
+  struct inode *indexNode = openFile->indexNode;
+  if (regINodeType != indexNode->type) {
     return -1;
   }
 
@@ -214,93 +385,875 @@ static int rd_lseek_kernel(int inodeNum, int offset, int *offset_toReturn) {
   } else {
     *offset_toReturn = offset;
   }
+  initFilePosn(&openFile->filePosition, indexNode, *offset_toReturn, 1);
 
   return 0;
 }
 
 
 
-// unlink file at path, free memory
-static int rd_unlink_kernel(char *path) {
+// zero length bytes at offset of the open file without moving its position, the file grows if
+// the range ends past it, whole blocks in the range are released instead of cleared
+static int rd_zero_range_kernel(int handle, int offset, int length)
+{
+  struct open_file *openFile = getOpenFile(handle);
+  if (NULL == openFile) {
+    return -1;
+  }
+
+  // error check: if directory
+  struct inode *indexNode = openFile->indexNode;
+  if (regINodeType != indexNode->type) {
+    return -1;
+  }
+
+  // error check: range inside the largest file
+  if ((offset < 0) || (length < 0) || (offset > MAX_FILE_SIZE)) {
+    return -1;
+  }
+  if (MAX_FILE_SIZE - offset < length) {
+    length = MAX_FILE_SIZE - offset;
+  }
+  int end = offset + length;
+
+  if (indexNode->flags & INODE_INLINE_DATA) {
+    if (end <= INODE_INLINE_CAP) {
+      memset(indexNode->inlineData + offset, 0, length);
+      indexNode->size = (end > indexNode->size) ? end : indexNode->size;
+      return 0;
+    }
+    if (0 != migrateInlineData(indexNode)) {
+      return -1;
+    }
+  }
+
+  if (indexNode->flags & INODE_COMPRESS) {
+    if (writeCompressed(indexNode, offset, NULL, length) != length) {
+      return -1;
+    }
+    return 0;
+  }
+
+  struct file_posn filePosition;
+  initFilePosn(&filePosition, indexNode, offset, 0);
+
+  int pos = offset;
+  while (pos < end) {
+    int currZeroLen = BLOCK_SIZE - filePosition.dataBlockOffset;
+    if (currZeroLen > end - pos) {
+      currZeroLen = end - pos;
+    }
+
+    if (BLOCK_SIZE == currZeroLen) {
+      if (0 != punchBlock(&filePosition.blockPointer)) {
+        return -1;
+      }
+    } else if (isBlockMapped(&filePosition.blockPointer)) {
+      char *address = getMemAddress(&filePosition);
+      if (NULL == address) {
+        return -1;
+      }
+      memset(address, 0, currZeroLen);
+    }
+    filePosnAdjust(&filePosition, currZeroLen);
+    pos = pos + currZeroLen;
+    indexNode->size = (pos > indexNode->size) ? pos : indexNode->size;
+  }
+
+  return 0;
+}
+
+// unlink file at path, free memory, relative paths start at directory dirNum
+static int rd_unlink_at(int dirNum, char *path) {
   // error check: if root directory, return -1
   if ((0 == strcmp("", path)) || (0 == strcmp("/", path))) {
     return -1;
   }
 
   // Error check: If parent directory exists
-  struct inode *parent_inode = getDirIndexNode(path);
+  struct inode *parent_inode = getDirIndexNodeAt(getINode(dirNum), path);
   if (NULL == parent_inode) {
     return -1;
   }
 
   // error check: if path exists
   const char *filename = UsingPathGetFileName(path);
-  struct directory_entry *entry = getDirectory(parent_inode, filename, NULL);
+  int entryPos = 0;
+  struct directory_entry *entry = findDirEntry(parent_inode, filename, NULL, &entryPos);
   if (NULL == entry) {
     return -1;
   }
 
   // error check: if directory has contents, return -1
   struct inode *indexNode = getINode(entry->inodeNum);
-  if ((0 == strcmp("dir", indexNode->type)) && (indexNode->dirCount > 0)) {
+  if ((dirINodeType == indexNode->type) && (indexNode->dirCount > 0)) {
     return -1;
   }
 
+  // other names keep the inode, open or not
+  if (indexNode->linkCount > 1) {
+    indexNode->linkCount--;
+    removeFromParentDir(parent_inode, entry, entryPos);
+    return 0;
+  }
+
   // error check: if file is open, return -1
   if (indexNode->filesOpen > 0) {
     return -1;
   }
 
-  // free inode memory, return to unused, remove directory entry
-  freeINodeMem(indexNode);
-  memset(indexNode, 0, sizeof(struct inode));
-  struct super_block *superblock = (superblock *)ramdisk;
-  superblock->freeINodes++;
-  memset(entry, 0, sizeof(struct directory_entry));
-  parent_inode->dirCount--;
+  // release the inode, large files are freed in the background, remove directory entry
+  releaseINodeDeferred(indexNode);
+  removeFromParentDir(parent_inode, entry, entryPos);
+
+  return 0;
+}
+
+// path calls resolving from the root
+static int rd_creat_kernel(char *path) {
+  return rd_creat_at(0, path);
+}
+
+static int rd_mkdir_kernel(char *path) {
+  return rd_mkdir_at(0, path);
+}
+
+static int rd_unlink_kernel(char *path) {
+  return rd_unlink_at(0, path);
+}
+
+// open the file named by fileHandle without resolving any path, fails with a stale handle
+// once the inode was freed, whatever now lives in it
+static int rd_open_by_handle_kernel(struct rd_file_handle *fileHandle, int *handle) {
+  // error check: inode number in range
+  if ((fileHandle->inodeNum < 0) || (fileHandle->inodeNum > MAX_INODES)) {
+    return -1;
+  }
+
+  // error check: inode still holds the same file
+  struct inode *indexNode = getINode(fileHandle->inodeNum);
+  if (((regINodeType != indexNode->type) && (dirINodeType != indexNode->type)) ||
+      (fileHandle->generation != indexNode->generation)) {
+    return -1;
+  }
+
+  *handle = allocateOpenFile(fileHandle->inodeNum);
+  if (-1 == *handle) {
+    return -1;
+  }
+  indexNode->filesOpen++;
+
+  return 0;
+}
+
+// inode number of the directory open at dirHandle, -1 if it isn't an open directory
+static int getDirHandleINodeNum(int dirHandle) {
+  struct open_file *openFile = getOpenFile(dirHandle);
+  if ((NULL == openFile) || (dirINodeType != openFile->indexNode->type)) {
+    return -1;
+  }
+  return openFile->inodeNum;
+}
+
+// path calls resolving relative paths from the directory open at dirHandle, skipping the
+// components leading to it
+static int rd_creatat_kernel(int dirHandle, char *path) {
+  int dirNum = getDirHandleINodeNum(dirHandle);
+  if (-1 == dirNum) {
+    return -1;
+  }
+  return rd_creat_at(dirNum, path);
+}
+
+static int rd_mkdirat_kernel(int dirHandle, char *path) {
+  int dirNum = getDirHandleINodeNum(dirHandle);
+  if (-1 == dirNum) {
+    return -1;
+  }
+  return rd_mkdir_at(dirNum, path);
+}
+
+static int rd_openat_kernel(int dirHandle, char *path, int *handle) {
+  int dirNum = getDirHandleINodeNum(dirHandle);
+  if (-1 == dirNum) {
+    return -1;
+  }
+  return rd_open_at(dirNum, path, handle);
+}
+
+static int rd_unlinkat_kernel(int dirHandle, char *path) {
+  int dirNum = getDirHandleINodeNum(dirHandle);
+  if (-1 == dirNum) {
+    return -1;
+  }
+  return rd_unlink_at(dirNum, path);
+}
+
+// move the entry at srcPath to dstPath, relinking the inode without touching its data
+// an existing dstPath is replaced if it is the same kind as srcPath, closed, and an empty directory if one
+static int rd_rename_kernel(char *srcPath, char *dstPath)
+{
+  // error check: root can't be moved or replaced
+  if ((0 == strcmp("", srcPath)) || (0 == strcmp("/", srcPath)) ||
+      (0 == strcmp("", dstPath)) || (0 == strcmp("/", dstPath))) {
+    return -1;
+  }
+
+  // error check: if source exists
+  struct inode *srcParent = getDirIndexNode(srcPath);
+  if (NULL == srcParent) {
+    return -1;
+  }
+  const char *srcName = UsingPathGetFileName(srcPath);
+  struct directory_entry *srcEntry = getDirectory(srcParent, srcName, NULL);
+  if (NULL == srcEntry) {
+    return -1;
+  }
+  int inodeNum = srcEntry->inodeNum;
+  struct inode *indexNode = getINode(inodeNum);
+
+  // error check: if destination parent exists and name is valid
+  struct inode *dstParent = getDirIndexNode(dstPath);
+  if (NULL == dstParent) {
+    return -1;
+  }
+  const char *dstName = UsingPathGetFileName(dstPath);
+  int nameLen = strlen(dstName);
+  if ((0 == nameLen) || (nameLen > RD_MAX_NAME_LEN)) {
+    return -1;
+  }
+
+  // error check: a directory can't move below itself
+  if (pathPassesThrough(dstPath, indexNode)) {
+    return -1;
+  }
+
+  struct directory_entry *dstEntry = getDirectory(dstParent, dstName, NULL);
+  if (NULL != dstEntry) {
+    if (dstEntry->inodeNum == inodeNum) {
+      return 0; // same inode under both names, nothing to do
+    }
+
+    // error check: replaced entry must be the same kind, and closed and empty unless other names keep it
+    struct inode *oldNode = getINode(dstEntry->inodeNum);
+    int lastLink = (oldNode->linkCount <= 1);
+    if ((oldNode->type != indexNode->type) || (lastLink && (oldNode->filesOpen > 0)) ||
+        ((dirINodeType == oldNode->type) && (oldNode->dirCount > 0))) {
+      return -1;
+    }
+
+    // repoint the existing entry, dstPath never stops resolving
+    dstEntry->inodeNum = inodeNum;
+    if (lastLink) {
+      releaseINodeDeferred(oldNode);
+    } else {
+      oldNode->linkCount--;
+    }
+  } else if (0 != addToParentDir(dstParent, dstName, inodeNum)) {
+    return -1; // no space, nothing changed
+  }
+
+  // adding may have moved the entries of a shared parent, look the source up again
+  int srcPos = 0;
+  srcEntry = findDirEntry(srcParent, srcName, NULL, &srcPos);
+  removeFromParentDir(srcParent, srcEntry, srcPos);
+
+  return 0;
+}
+
+// add dstPath as another name for the regular file at srcPath, both share the inode and its blocks
+static int rd_link_kernel(char *srcPath, char *dstPath)
+{
+  // error check: if source exists
+  struct inode *srcParent = getDirIndexNode(srcPath);
+  if (NULL == srcParent) {
+    return -1;
+  }
+  struct directory_entry *srcEntry = getDirectory(srcParent, UsingPathGetFileName(srcPath), NULL);
+  if (NULL == srcEntry) {
+    return -1;
+  }
+
+  // error check: only regular files get more names, and only so many
+  int inodeNum = srcEntry->inodeNum;
+  struct inode *indexNode = getINode(inodeNum);
+  if ((regINodeType != indexNode->type) || (indexNode->linkCount >= MAX_LINK_COUNT)) {
+    return -1;
+  }
+
+  // error check: if destination parent exists and name is free and valid
+  struct inode *dstParent = getDirIndexNode(dstPath);
+  if (NULL == dstParent) {
+    return -1;
+  }
+  const char *dstName = UsingPathGetFileName(dstPath);
+  if (NULL != getDirectory(dstParent, dstName, NULL)) {
+    return -1;
+  }
+  int nameLen = strlen(dstName);
+  if ((0 == nameLen) || (nameLen > RD_MAX_NAME_LEN)) {
+    return -1;
+  }
+
+  if (0 != addToParentDir(dstParent, dstName, inodeNum)) {
+    return -1;
+  }
+  indexNode->linkCount++;
+
+  return 0;
+}
+
+// walkTree visit, non zero if inodeNum is open
+static int isINodeOpen(int inodeNum) {
+  return getINode(inodeNum)->filesOpen > 0;
+}
+
+// walkTree visit, drop one name of inodeNum and free it along with its blocks if that was the last
+static int releaseTreeINode(int inodeNum) {
+  struct inode *indexNode = getINode(inodeNum);
+  if (indexNode->linkCount > 1) {
+    indexNode->linkCount--;
+    return 0;
+  }
+  releaseINodeDeferred(indexNode);
+  return 0;
+}
+
+// remove path and, for a directory, everything below it in one pass, files also named from
+// outside the tree keep those names, fails without changing anything if anything in the tree is open
+static int rd_rmtree_kernel(char *path)
+{
+  // error check: root can't be removed
+  if ((0 == strcmp("", path)) || (0 == strcmp("/", path))) {
+    return -1;
+  }
+
+  // error check: if path exists
+  struct inode *parent_inode = getDirIndexNode(path);
+  if (NULL == parent_inode) {
+    return -1;
+  }
+  int entryPos = 0;
+  struct directory_entry *entry = findDirEntry(parent_inode, UsingPathGetFileName(path), NULL, &entryPos);
+  if (NULL == entry) {
+    return -1;
+  }
+
+  // error check: if anything in the tree is open
+  int inodeNum = entry->inodeNum;
+  if (0 != walkTree(inodeNum, isINodeOpen)) {
+    return -1;
+  }
+
+  walkTree(inodeNum, releaseTreeINode);
+  removeFromParentDir(parent_inode, entry, entryPos);
+
+  return 0;
+}
+
+// move the data blocks of the regular file at path into one run of consecutive free blocks in file order,
+// blocks shared with a clone or through dedup stay put, fails if no free run is long enough
+static int rd_defrag_kernel(char *path)
+{
+  // error check: if path is a regular file
+  int inodeNum = getPathINodeNum(path);
+  if (-1 == inodeNum) {
+    return -1;
+  }
+  struct inode *indexNode = getINode(inodeNum);
+  if (regINodeType != indexNode->type) {
+    return -1;
+  }
+
+  // inline contents and files already in one piece have nothing to move
+  if ((indexNode->flags & INODE_INLINE_DATA) || (countExtents(indexNode) <= 1)) {
+    return 0;
+  }
+
+  // the blocks of unlinked files are given back first, dropping their shares, so the blocks
+  // counted as movable below are exactly the ones the copy loop moves
+  reclaimAllDeferredBlocks();
+
+  // give the file its own copy of every table first, so no table is copied into the run
+  // and count the blocks that can move
+  int blockCount = (indexNode->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  int moveCount = 0;
+  struct blk_ptr blockPointer;
+  for (int i = 0; i < blockCount; i++) {
+    initBlockPtr(&blockPointer, indexNode, i, 0);
+    if (!isBlockMapped(&blockPointer)) {
+      continue;
+    }
+    int *slot = getBlkPtrSlot(&blockPointer);
+    if (NULL == slot) {
+      return -1;
+    }
+    if (!isBlockShared(*slot)) {
+      moveCount++;
+    }
+  }
+  if (0 == moveCount) {
+    return 0;
+  }
+
+  // first free run long enough for all of them
+  int count = 0;
+  int start = nextFreeExtent(META_BLK_COUNT, &count);
+  while ((start >= 0) && (count < moveCount)) {
+    start = nextFreeExtent(start + count, &count);
+  }
+  if (start < 0) {
+    return -1;
+  }
+
+  // copy block by block into the run and repoint the file at the copies, never past the run
+  int target = start;
+  for (int i = 0; (i < blockCount) && (target < start + moveCount); i++) {
+    initBlockPtr(&blockPointer, indexNode, i, 0);
+    if (!isBlockMapped(&blockPointer)) {
+      continue;
+    }
+    int *slot = getBlkPtrSlot(&blockPointer);
+    if ((NULL == slot) || isBlockShared(*slot)) {
+      continue;
+    }
+    if (-1 == allocateBlockAt(target)) {
+      return -1; // every block moved so far is already repointed
+    }
+    memcpy(getBlockAddress(target), getBlockAddress(*slot), BLOCK_SIZE);
+    freeBlock(*slot);
+    *slot = target;
+    target++;
+  }
+  blockMapGeneration++;
+
+  return 0;
+}
+
+// create a regular file for each of the count NUL terminated names packed in namesLen bytes at names,
+// all in the directory at dirPath, which is resolved once, returns how many were created before the first failure
+// names taken in the directory or repeated in the batch are found with one directory scan and a hash of the batch
+static int rd_create_many_kernel(char *dirPath, char *names, int namesLen, int count)
+{
+  // error check: if directory exists
+  int dirNum = getPathINodeNum(dirPath);
+  if (-1 == dirNum) {
+    return -1;
+  }
+  struct inode *parent_inode = getINode(dirNum);
+  if (dirINodeType != parent_inode->type) {
+    return -1;
+  }
+
+  // error check: names end inside the buffer and are single path components
+  int batchLen = loadBatchNames(names, namesLen, count);
 
-  // free parent if it has no directory entries
-  if (0 == parent_inode->dirCount) {
-    freeINodeMem(parent_inode);
+  // stop short of the first name that is repeated or already taken
+  batchLen = indexBatchNames(batchLen);
+  batchLen = firstBatchNameInDir(parent_inode, batchLen);
+
+  // once no empty slot fits, every later entry goes to the end of the directory
+  int reuseSlot = (parent_inode->dirTombstones > 0);
+  int created = 0;
+  while (created < batchLen) {
+    int size = parent_inode->size;
+    if (0 != addFileToDir(parent_inode, batchNames[created], reuseSlot)) {
+      break;
+    }
+    if (parent_inode->size != size) {
+      reuseSlot = 0;
+    }
+    created++;
+  }
+
+  return created;
+}
+
+// read a single entry from directory open at handle at its cursor, store at address
+static int rd_readdir_kernel(int handle, char *address)
+{
+  struct open_file *openFile = getOpenFile(handle);
+  if (NULL == openFile) {
+    return -1;
+  }
+
+  // error check if regular file
+  struct inode *indexNode = openFile->indexNode;
+  if (dirINodeType != indexNode->type) {
+    return -1;
+  }
+
+  int pos = openFile->dirPosition;
+  while (pos < indexNode->size) { // iterate through directory from the cursor
+    struct directory_entry *entry = (struct directory_entry *)getDirCursorAddress(openFile, pos);
+    if ((NULL == entry) || (0 == entry->recordLen)) {
+      break;
+    }
+
+    pos = pos + entry->recordLen; // skip to the next entry
+
+    if (entry->nameLen > 0) {
+      struct rd_dirent *dirent = (struct rd_dirent *)address;
+      memcpy(dirent->filename, entry->filename, entry->nameLen);
+      dirent->filename[entry->nameLen] = '\0';
+      dirent->inodeNum = entry->inodeNum;
+      openFile->dirPosition = pos;
+      return 1;
+    }
+  }
+
+  // cursor at the end of the directory
+  openFile->dirPosition = pos;
+
+  return 0;
+}
+
+// resolve path to the handle of its file, and its attributes too if stat isn't NULL
+// changes nothing, so rd_ioctl runs it without rdLock and retries if the namespace changed meanwhile
+static int rd_lookup_kernel(char *path, struct rd_file_handle *fileHandle, struct rd_stat *stat)
+{
+  // error check: if path exists
+  int inodeNum = getPathINodeNum(path);
+  if (-1 == inodeNum) {
+    return -1;
+  }
+
+  fileHandle->inodeNum = inodeNum;
+  fileHandle->generation = getINode(inodeNum)->generation;
+  if (NULL != stat) {
+    fillStat(inodeNum, stat);
   }
 
   return 0;
 }
 
-// read a single entry from directory at fd, store at address
-static int rd_readdir_kernel(int inodeNum, char *address, int *pos)
+// store up to maxEntries entries of the directory open at handle, each with the attributes of its inode,
+// at address from its cursor on, returns the number stored, 0 at the end of the directory
+static int rd_readdirplus_kernel(int handle, struct rd_direntplus *address, int maxEntries)
 {
+  struct open_file *openFile = getOpenFile(handle);
+  if (NULL == openFile) {
+    return -1;
+  }
+
   // error check if regular file
+  struct inode *indexNode = openFile->indexNode;
+  if ((dirINodeType != indexNode->type) || (maxEntries < 0)) {
+    return -1;
+  }
+
+  struct rd_direntplus direntPlus;
+  int pos = openFile->dirPosition;
+  int count = 0;
+  while ((count < maxEntries) && (pos < indexNode->size)) {
+    struct directory_entry *entry = (struct directory_entry *)getDirCursorAddress(openFile, pos);
+    if ((NULL == entry) || (0 == entry->recordLen)) {
+      break;
+    }
+
+    pos = pos + entry->recordLen; // skip to the next entry
+
+    if (entry->nameLen > 0) {
+      memset(&direntPlus, 0, sizeof(struct rd_direntplus));
+      memcpy(direntPlus.dirent.filename, entry->filename, entry->nameLen);
+      direntPlus.dirent.inodeNum = entry->inodeNum;
+      fillStat(entry->inodeNum, &direntPlus.stat);
+      if (0 != copy_to_user(address + count, &direntPlus, sizeof(struct rd_direntplus))) {
+        return -1;
+      }
+      count++;
+    }
+  }
+  openFile->dirPosition = pos;
+
+  return count;
+}
+
+
+
+
+
+
+
+// dump superblock, inode array, bitmap and the used data blocks to address as one image
+// imageLen receives the image size, fails without writing if bufLen is too small
+static int rd_snapshot_kernel(char *address, int bufLen, int *imageLen)
+{
+  struct rd_image_header header;
+  struct rd_image_extent extent;
+  int start = 0;
+  int count = 0;
+
+  // blocks waiting to be reclaimed would be saved as used
+  reclaimAllDeferredBlocks();
+
+  // size the image, metadata blocks are copied whole
+  header.magic = RD_IMAGE_MAGIC;
+  header.version = RD_IMAGE_VERSION;
+  header.blockSize = BLOCK_SIZE;
+  header.totalBlocks = TOTAL_BLK_COUNT;
+  header.metaBlocks = META_BLK_COUNT;
+  header.extentCount = 0;
+  *imageLen = sizeof(struct rd_image_header) + (META_BLK_COUNT * BLOCK_SIZE);
+  for (start = nextUsedExtent(META_BLK_COUNT, &count); start >= 0; start = nextUsedExtent(start + count, &count)) {
+    header.extentCount++;
+    *imageLen = *imageLen + sizeof(struct rd_image_extent) + (count * BLOCK_SIZE);
+  }
+
+  if ((NULL == address) || (bufLen < *imageLen)) {
+    return -1;
+  }
+
+  // stream header, metadata and every used extent to the user buffer
+  char *dst = address;
+  if (0 != copy_to_user(dst, &header, sizeof(struct rd_image_header))) {
+    return -1;
+  }
+  dst = dst + sizeof(struct rd_image_header);
+  if (0 != copy_to_user(dst, ramdisk, META_BLK_COUNT * BLOCK_SIZE)) {
+    return -1;
+  }
+  dst = dst + (META_BLK_COUNT * BLOCK_SIZE);
+
+  for (start = nextUsedExtent(META_BLK_COUNT, &count); start >= 0; start = nextUsedExtent(start + count, &count)) {
+    extent.start = start;
+    extent.count = count;
+    if (0 != copy_to_user(dst, &extent, sizeof(struct rd_image_extent))) {
+      return -1;
+    }
+    dst = dst + sizeof(struct rd_image_extent);
+    if (0 != copy_to_user(dst, getBlockAddress(start), count * BLOCK_SIZE)) {
+      return -1;
+    }
+    dst = dst + (count * BLOCK_SIZE);
+  }
+
+  return 0;
+}
+
+// replace the whole ramdisk with an image written by rd_snapshot_kernel, no file may be open
+// address is kernel memory, the ioctl layer copies the image in before calling here
+static int rd_restore_kernel(const char *address, int imageLen)
+{
+  struct rd_image_header header;
+  struct rd_image_extent extent;
+  struct super_block imageSuper;
+
+  // error check: open files would point into the old tree
+  if (openFileCount > 0) {
+    return -1;
+  }
+
+  // error check: image must match this ramdisk's geometry
+  if ((NULL == address) || (imageLen < (int)sizeof(struct rd_image_header))) {
+    return -1;
+  }
+  memcpy(&header, address, sizeof(struct rd_image_header));
+  if ((RD_IMAGE_MAGIC != header.magic) || (RD_IMAGE_VERSION != header.version) ||
+      (BLOCK_SIZE != header.blockSize) || (TOTAL_BLK_COUNT != header.totalBlocks) ||
+      (META_BLK_COUNT != header.metaBlocks) || (header.extentCount < 0)) {
+    return -1;
+  }
+
+  // error check: the metadata must be laid out the way this module reads it
+  if (imageLen < (int)(sizeof(struct rd_image_header) + sizeof(struct super_block))) {
+    return -1;
+  }
+  memcpy(&imageSuper, address + sizeof(struct rd_image_header), sizeof(struct super_block));
+  if ((RD_SUPER_MAGIC != imageSuper.magic) || (RD_LAYOUT_VERSION != imageSuper.layoutVersion)) {
+    return -1;
+  }
+
+  // walk the extent list first so a bad image leaves the ramdisk untouched
+  int metaLen = META_BLK_COUNT * BLOCK_SIZE;
+  int pos = sizeof(struct rd_image_header) + metaLen;
+  int prevEnd = META_BLK_COUNT;
+  for (int i = 0; i < header.extentCount; i++) {
+    if ((pos + (int)sizeof(struct rd_image_extent)) > imageLen) {
+      return -1;
+    }
+    memcpy(&extent, address + pos, sizeof(struct rd_image_extent));
+    if ((extent.start < prevEnd) || (extent.count <= 0) || (extent.count > (TOTAL_BLK_COUNT - extent.start))) {
+      return -1;
+    }
+    pos = pos + sizeof(struct rd_image_extent) + (extent.count * BLOCK_SIZE);
+    prevEnd = extent.start + extent.count;
+  }
+  if (pos != imageLen) {
+    return -1;
+  }
+
+  // bulk copy metadata then every extent into place
+  memcpy(ramdisk, address + sizeof(struct rd_image_header), metaLen);
+  pos = sizeof(struct rd_image_header) + metaLen;
+  for (int i = 0; i < header.extentCount; i++) {
+    memcpy(&extent, address + pos, sizeof(struct rd_image_extent));
+    pos = pos + sizeof(struct rd_image_extent);
+    memcpy(getBlockAddress(extent.start), address + pos, extent.count * BLOCK_SIZE);
+    pos = pos + (extent.count * BLOCK_SIZE);
+  }
+  blockMapGeneration++;
+  dedupReset();
+  deferredFreeReset();
+  clearOpenCounts(); // the image was taken with files open, none are open here
+
+  return 0;
+}
+
+// clone inode srcNum under dstParent as name, regular files share their blocks copy on write
+// and directories are cloned entry by entry, a failure part way leaves what was cloned so far
+// for rd_clone_kernel to undo
+static int cloneINode(int srcNum, struct inode *dstParent, const char *name, int depth)
+{
+  // error check: nesting too deep
+  if (depth > RD_MAX_CLONE_DEPTH) {
+    return -1;
+  }
+
+  // error check: if there is a free inode for the clone
+  int inodeNum = getAvailableNode();
+  if (-1 == inodeNum) {
+    return -1;
+  }
+
+  struct inode *srcNode = getINode(srcNum);
   struct inode *indexNode = getINode(inodeNum);
-  if (0 != strcmp("dir", indexNode->type)) {
+  resetINode(indexNode);
+  indexNode->type = srcNode->type;
+  indexNode->linkCount = 1;
+
+  if (regINodeType == srcNode->type) {
+    if (0 != shareINodeBlocks(indexNode, srcNode)) {
+      releaseINode(indexNode);
+      return -1;
+    }
+  } else {
+    indexNode->flags = INODE_INLINE_DATA | (srcNode->flags & INODE_USER_FLAGS); // entries are added one by one below
+  }
+
+  if (0 != addToParentDir(dstParent, name, inodeNum)) {
+    freeINodeMem(indexNode);
+    releaseINode(indexNode);
     return -1;
   }
-  // initialize needed struct
+
+  if (dirINodeType != srcNode->type) {
+    return 0;
+  }
+
+  // clone every child of the source directory into the new one
+  char childName[RD_MAX_NAME_LEN + 1];
   struct file_posn filePosition;
-  initFilePosn(&filePosition, indexNode, *pos, 1);
+  initFilePosn(&filePosition, srcNode, 0, 1);
 
-  while (filePosition.filePosition < indexNode->size) { // iterate through directory to specified posn
+  while (filePosition.filePosition < srcNode->size) {
     struct directory_entry *entry = (struct directory_entry *)getMemAddress(&filePosition);
-    if (NULL == entry) {
+    if ((NULL == entry) || (0 == entry->recordLen)) {
       break;
     }
+    filePosnAdjust(&filePosition, entry->recordLen);
 
-    filePosnAdjust(&filePosition, sizeof(struct directory_entry)); // increases by 16
-
-    if (0 != strcmp(entry->filename, "")) {
-      memcpy(address, entry, sizeof(struct directory_entry));
-      *pos = filePosition.filePosition;
-      return 1;
+    if (0 == entry->nameLen) {
+      continue;
+    }
+    memcpy(childName, entry->filename, entry->nameLen);
+    childName[entry->nameLen] = '\0';
+    if (0 != cloneINode(entry->inodeNum, indexNode, childName, depth + 1)) {
+      return -1;
     }
   }
-  
-  // increment posn, end of file
-  *pos = filePosition.filePosition;
 
   return 0;
 }
 
+// clone file or directory at srcPath to dstPath without copying data blocks
+static int rd_clone_kernel(char *srcPath, char *dstPath)
+{
+  // error check: root can't be cloned
+  if ((0 == strcmp("", srcPath)) || (0 == strcmp("/", srcPath))) {
+    return -1;
+  }
 
+  // error check: if source exists
+  struct inode *srcParent = getDirIndexNode(srcPath);
+  if (NULL == srcParent) {
+    return -1;
+  }
+  struct directory_entry *entry = getDirectory(srcParent, UsingPathGetFileName(srcPath), NULL);
+  if (NULL == entry) {
+    return -1;
+  }
 
+  // error check: if destination parent exists and name is free and valid
+  struct inode *dstParent = getDirIndexNode(dstPath);
+  if (NULL == dstParent) {
+    return -1;
+  }
+  const char *dstName = UsingPathGetFileName(dstPath);
+  if (NULL != getDirectory(dstParent, dstName, NULL)) {
+    return -1;
+  }
+  int nameLen = strlen(dstName);
+  if ((0 == nameLen) || (nameLen > RD_MAX_NAME_LEN)) {
+    return -1;
+  }
+
+  // error check: a directory can't be cloned into itself
+  if (pathPassesThrough(dstPath, getINode(entry->inodeNum))) {
+    return -1;
+  }
+
+  if (0 == cloneINode(entry->inodeNum, dstParent, dstName, 0)) {
+    return 0;
+  }
+
+  // all or nothing, release the part of the tree cloned before the failure
+  int entryPos = 0;
+  struct directory_entry *dstEntry = findDirEntry(dstParent, dstName, NULL, &entryPos);
+  if (NULL != dstEntry) {
+    walkTree(dstEntry->inodeNum, releaseTreeINode);
+    removeFromParentDir(dstParent, dstEntry, entryPos);
+  }
+
+  return -1;
+}
+
+// set the mode flags of the file or directory at path, flags outside INODE_USER_FLAGS are refused
+// a dedup switch only affects later writes, a compression switch rewrites the file's data
+static int rd_setflags_kernel(char *path, int flags)
+{
+  // error check: only user settable flags
+  if (0 != (flags & ~INODE_USER_FLAGS)) {
+    return -1;
+  }
+
+  struct inode *indexNode = NULL;
+  if ((0 == strcmp("", path)) || (0 == strcmp("/", path))) {
+    struct super_block *superblock = (struct super_block *)ramdisk;
+    indexNode = &superblock->first;
+  } else {
+    // error check: if path exists
+    struct inode *parent_inode = getDirIndexNode(path);
+    if (NULL == parent_inode) {
+      return -1;
+    }
+    struct directory_entry *entry = getDirectory(parent_inode, UsingPathGetFileName(path), NULL);
+    if (NULL == entry) {
+      return -1;
+    }
+    indexNode = getINode(entry->inodeNum);
+  }
 
+  // compressed mode reads raw chunks too, so it is turned on before the rewrite and off only after it completes
+  int compressChange = (indexNode->flags ^ flags) & INODE_COMPRESS;
+  if (compressChange && (regINodeType == indexNode->type) && !(indexNode->flags & INODE_INLINE_DATA)) {
+    indexNode->flags |= INODE_COMPRESS;
+    if (0 != recompressINode(indexNode, flags & INODE_COMPRESS)) {
+      return -1;
+    }
+  }
 
+  indexNode->flags = (indexNode->flags & ~INODE_USER_FLAGS) | flags;
+
+  return 0;
+}
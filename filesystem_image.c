@@ -0,0 +1,123 @@
+// userspace driver for the ramdisk engine backed by an image file, built with -DRD_USERSPACE
+//   filesystem_image IMAGE ls DIR      list a directory
+//   filesystem_image IMAGE mkdir PATH  create a directory
+//   filesystem_image IMAGE put PATH    create or overwrite a file with stdin
+//   filesystem_image IMAGE cat PATH    copy a file to stdout
+//   filesystem_image IMAGE rm PATH     unlink a file or an empty directory
+// a missing image is created and formatted, every change is synced back before exiting
+
+#include <stdio.h>
+
+#include "filesystem_functions_kernel.h"
+
+#define COPY_BUF_SIZE 4096
+
+// open path the way RD_OPEN does, -1 if it doesn't resolve
+static int openPath(char *path)
+{
+  struct rd_file_handle fileHandle;
+  int handle = -1;
+
+  if ((0 != rd_lookup_kernel(path, &fileHandle, NULL)) ||
+      (0 != rd_open_by_handle_kernel(&fileHandle, &handle))) {
+    return -1;
+  }
+  return handle;
+}
+
+static int listDir(char *path)
+{
+  struct rd_dirent dirent;
+
+  int handle = openPath(path);
+  if (-1 == handle) {
+    return -1;
+  }
+  while (rd_readdir_kernel(handle, (char *)&dirent) > 0) {
+    printf("%s\n", dirent.filename);
+  }
+  rd_close_kernel(handle);
+
+  return 0;
+}
+
+static int putFile(char *path)
+{
+  char buf[COPY_BUF_SIZE];
+  int pos = 0;
+
+  // overwrite by starting from an empty file
+  rd_unlink_kernel(path);
+  if (0 != rd_creat_kernel(path)) {
+    return -1;
+  }
+  int handle = openPath(path);
+  if (-1 == handle) {
+    return -1;
+  }
+
+  int ret = 0;
+  size_t len;
+  while ((0 == ret) && ((len = fread(buf, 1, sizeof(buf), stdin)) > 0)) {
+    if ((int)len != rd_write_kernel(handle, buf, (int)len, &pos)) {
+      ret = -1;
+    }
+  }
+  rd_close_kernel(handle);
+
+  return ret;
+}
+
+static int catFile(char *path)
+{
+  char buf[COPY_BUF_SIZE];
+  int pos = 0;
+  int len;
+
+  int handle = openPath(path);
+  if (-1 == handle) {
+    return -1;
+  }
+  while ((len = rd_read_kernel(handle, buf, sizeof(buf), &pos)) > 0) {
+    fwrite(buf, 1, len, stdout);
+  }
+  rd_close_kernel(handle);
+
+  return (len < 0) ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (4 != argc) {
+    fprintf(stderr, "usage: %s IMAGE ls|mkdir|put|cat|rm PATH\n", argv[0]);
+    return 2;
+  }
+
+  if (0 != ramdiskInitFromFile(argv[1])) {
+    fprintf(stderr, "%s: not usable, wrong size or layout\n", argv[1]);
+    return 1;
+  }
+
+  char *cmd = argv[2];
+  char *path = argv[3];
+  int ret = -1;
+  if (0 == strcmp("ls", cmd)) {
+    ret = listDir(path);
+  } else if (0 == strcmp("mkdir", cmd)) {
+    ret = rd_mkdir_kernel(path);
+  } else if (0 == strcmp("put", cmd)) {
+    ret = putFile(path);
+  } else if (0 == strcmp("cat", cmd)) {
+    ret = catFile(path);
+  } else if (0 == strcmp("rm", cmd)) {
+    ret = rd_unlink_kernel(path);
+  } else {
+    fprintf(stderr, "%s: unknown command %s\n", argv[0], cmd);
+  }
+  if (0 != ret) {
+    fprintf(stderr, "%s %s: failed\n", cmd, path);
+  }
+
+  uninitialize(); // syncs the image
+  return (0 == ret) ? 0 : 1;
+}
@@ -1,18 +1,37 @@
 
-#define NULL 0
-
+#ifdef RD_USERSPACE
+#include "filesystem_userspace.h"
+#else
 #include <linux/uaccess.h>
 #include <linux/vmalloc.h>
 
 #include <linux/string.h>
+#include <linux/prefetch.h>
+#include <linux/bug.h>
+#include <linux/lz4.h>
+#endif
 
+#include "filesystem_structs.h"
 #include "filesystem_kernel.h"
 
 static unsigned char *ramdisk;
+static struct open_file *openFileTable;
+static int openFileFreeList = -1;
+static int openFileCount;
+
+//bumped whenever a block is released or repointed, or blocks gain a holder through a clone,
+//so cached block numbers and tables get revalidated
+static unsigned int blockMapGeneration;
+
+#ifdef RD_USERSPACE
+//set while the ramdisk is an mmap'd image file rather than vmalloc memory
+static int ramdiskMapped;
+#endif
 
 
 #define RD_MEM_CAP (2 * 1024 * 1024)
 #define MAX_INODES 1024
+#define MAX_OPEN_FILES 4096
 #define INODE_ARRAY_BLK_COUNT 256
 #define BITMAP_BLK_COUNT 4
 #define BLOCK_SIZE 256	
@@ -23,31 +42,169 @@ static unsigned char *ramdisk;
 #define TOTAL_SINGLE_INDIR_BLK_PTRS 1
 #define TOTAL_DOUBLE_INDIR_BLK_PTRS 1
 
+//slots of the single and double indirect block pointers in inode location[]
+#define SINGLE_INDIR_LOC TOTAL_DIRECT_BLK_PTRS
+#define DOUBLE_INDIR_LOC (TOTAL_DIRECT_BLK_PTRS + TOTAL_SINGLE_INDIR_BLK_PTRS)
+
+//consecutive reads at the previous end position before read-ahead kicks in
+#define SEQ_READ_THRESHOLD 2
+
+//blocks in the ramdisk, the share count array after the bitmap keeps one unsigned short per block
+#define TOTAL_BLK_COUNT (RD_MEM_CAP / BLOCK_SIZE)
+#define SHARE_BLK_COUNT ((TOTAL_BLK_COUNT * sizeof(unsigned short)) / BLOCK_SIZE)
+#define MAX_BLOCK_SHARES 0xFFFF
+
+//leading blocks holding superblock, inode array, bitmap and share counts
+#define META_BLK_COUNT (1 + INODE_ARRAY_BLK_COUNT + BITMAP_BLK_COUNT + SHARE_BLK_COUNT)
+
+//number of block pointers in inode location[]
+#define LOCATION_COUNT (TOTAL_DIRECT_BLK_PTRS + TOTAL_SINGLE_INDIR_BLK_PTRS + TOTAL_DOUBLE_INDIR_BLK_PTRS)
+
+//directory nesting a clone copies before giving up
+#define RD_MAX_CLONE_DEPTH 16
+
+//buckets of the dedup index, a power of two
+#define DEDUP_TABLE_SIZE 4096
+
+//dedup index, content hash -> block number, lives in kernel memory and starts empty after a restore
+//a block is only trusted while its dedupIndexed bit is set and its contents still compare equal
+static int dedupTable[DEDUP_TABLE_SIZE];
+static unsigned char dedupIndexed[TOTAL_BLK_COUNT / 8];
+
+//lz4 state plus staging for one compressed and one decompressed chunk
+static void *compressWorkspace;
+static char compressBuffer[COMPRESS_CHUNK_SIZE];
+static char chunkData[COMPRESS_CHUNK_SIZE];
+
+//decompressed chunks of compressed files, replaced round robin
+static struct chunk_cache_entry chunkCache[CHUNK_CACHE_ENTRIES];
+static int chunkCacheNext;
+
+//directories walkTree is inside of, at most every inode is a directory on the way down
+static struct tree_walk_frame treeWalkStack[MAX_INODES + 1];
+
+//unlinked inodes with block pointer tables queue here as reclaimINodeType, reclaimDeferredBlocks
+//frees their blocks later a bounded step at a time and only then releases the inode
+//an inode is queued at most once, so the queue never fills
+static int deferredFree[MAX_INODES];
+static int deferredFreeHead;
+static int deferredFreeCount;
+
+//buckets of the batch name index, a power of two with room for a batch naming every inode
+#define BATCH_NAME_BUCKETS 2048
+
+//names of one RD_CREATE_MANY batch, no more files than inodes can come out of it
+//batchNameIndex maps a name hash to its batch position + 1, 0 is an empty bucket
+static const char *batchNames[MAX_INODES];
+static int batchNameLens[MAX_INODES];
+static short batchNameIndex[BATCH_NAME_BUCKETS];
 
 #define MAX_BLOCK_COUNT_IN_FILE   (TOTAL_DIRECT_BLK_PTRS+ PTR_PER_BLOCK + PTR_PER_BLOCK * PTR_PER_BLOCK)
 #define MAX_FILE_SIZE   (MAX_BLOCK_COUNT_IN_FILE * BLOCK_SIZE)
 
 
-void ramdiskInitOperations() {
+//returns -1 if any of the memory can't be had, uninitialize releases what was allocated
+int ramdiskInitOperations() {
 
-    superblock *superblock = NULL;
-    indexNode *inodeArray = NULL;
-    unsigned char *block_bitmap = NULL;
+    //inodes are packed one per cache line, vmalloc memory is page aligned so the
+    //inode array one block in stays cache line aligned too
+    BUILD_BUG_ON(sizeof(struct inode) != INODE_SIZE);
+    BUILD_BUG_ON(BLOCK_SIZE % INODE_SIZE);
 
     //use vmalloc() to allocate 2MB for our ramdisk
     ramdisk = (unsigned char *)vmalloc(sizeof(unsigned char) * RD_MEM_CAP);
+    if (NULL == ramdisk) {
+      return -1;
+    }
+
+    formatRamdisk();
+    if ((0 != initOpenFileTable()) || (0 != initCompression())) {
+      return -1;
+    }
+
+    return 0;
+}
+
+#ifdef RD_USERSPACE
+//back the ramdisk with the image file at path instead of fresh memory, formatting it
+//if it holds no filesystem yet, pages fault in lazily and ramdiskSync persists them
+int ramdiskInitFromFile(const char *path) {
+    struct stat imageStat;
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+      return -1;
+    }
+
+    //a new image file is sized to the ramdisk, anything else must match it exactly
+    if ((0 != fstat(fd, &imageStat)) ||
+        ((0 == imageStat.st_size) && (0 != ftruncate(fd, RD_MEM_CAP))) ||
+        ((0 != imageStat.st_size) && (RD_MEM_CAP != imageStat.st_size))) {
+      close(fd);
+      return -1;
+    }
+
+    //mmap memory is page aligned just like vmalloc memory
+    void *image = mmap(NULL, RD_MEM_CAP, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == image) {
+      return -1;
+    }
+    ramdisk = (unsigned char *)image;
+    ramdiskMapped = 1;
+
+    //only the superblock page is touched to tell a formatted image from an empty one
+    struct super_block *superblock = (struct super_block *)ramdisk;
+    if (RD_SUPER_MAGIC != superblock->magic) {
+      formatRamdisk();
+    } else if (RD_LAYOUT_VERSION != superblock->layoutVersion) {
+      munmap(ramdisk, RD_MEM_CAP); // a filesystem, but laid out differently, leave it alone
+      ramdisk = NULL;
+      ramdiskMapped = 0;
+      return -1;
+    }
+    clearOpenCounts(); // the image may have been saved with files open, this process has none
+    deferredFreeReset(); // unlinked inodes whose blocks were still being freed when it was saved
+    if ((0 != initOpenFileTable()) || (0 != initCompression())) {
+      uninitialize();
+      return -1;
+    }
+
+    return 0;
+}
+
+//write the mapped image back to its file
+int ramdiskSync() {
+    if (!ramdiskMapped) {
+      return -1;
+    }
+    reclaimAllDeferredBlocks(); // the image must not keep blocks nobody references
+    return msync(ramdisk, RD_MEM_CAP, MS_SYNC);
+}
+#endif
+
+//lay out an empty filesystem, superblock, inode array and bitmap, in the ramdisk
+void formatRamdisk() {
+
+    struct super_block *superblock = NULL;
+    struct inode *inodeArray = NULL;
+    unsigned char *block_bitmap = NULL;
 
     //pointer to beginning of ramdisk
-    superblock = (superblock *)ramdisk;
-    setRamdisk(superblock, 0, BLOCK_SIZE);
+    superblock = (struct super_block *)ramdisk;
+    memset(superblock, 0, BLOCK_SIZE);
     superblock->freeBlocks = RD_MEM_CAP / BLOCK_SIZE;
     superblock->freeINodes = MAX_INODES; 
+    superblock->magic = RD_SUPER_MAGIC;
+    superblock->layoutVersion = RD_LAYOUT_VERSION;
 
-    strcpy(superblock->first.type, "dir");
+    superblock->first.type = dirINodeType;
+    superblock->first.flags = INODE_INLINE_DATA;
+    superblock->first.linkCount = 1;
 
     //initialize index node array
     inodeArray = getINode(1);
-    setRamdisk(inodeArray, 0, sizeof(unsigned char) * (BLOCK_SIZE * INODE_ARRAY_BLK_COUNT));
+    memset(inodeArray, 0, sizeof(unsigned char) * (BLOCK_SIZE * INODE_ARRAY_BLK_COUNT));
 
     //initialize block bitmap
     block_bitmap = (ramdisk + BLOCK_SIZE * (1 + INODE_ARRAY_BLK_COUNT));
@@ -61,26 +218,72 @@ void ramdiskInitOperations() {
       }
     }
 
-    for (int i = 0; i < (1 + INODE_ARRAY_BLK_COUNT + BITMAP_BLK_COUNT); i++){
+    //no block is shared yet
+    memset(block_bitmap + BLOCK_SIZE * BITMAP_BLK_COUNT, 0, SHARE_BLK_COUNT * BLOCK_SIZE);
+
+    for (int i = 0; i < META_BLK_COUNT; i++){
       allocateOneBlock();
     } 
 }
 
+//open file table lives outside the ramdisk, every slot starts on the free list
+int initOpenFileTable() {
+    openFileTable = (struct open_file *)vmalloc(sizeof(struct open_file) * MAX_OPEN_FILES);
+    if (NULL == openFileTable) {
+      return -1;
+    }
+    memset(openFileTable, 0, sizeof(struct open_file) * MAX_OPEN_FILES);
+    openFileFreeList = -1;
+    openFileCount = 0;
+    for (int i = MAX_OPEN_FILES - 1; i >= 0; i--) {
+      openFileTable[i].nextFree = openFileFreeList;
+      openFileFreeList = i;
+    }
+
+    return 0;
+}
+
+//take the free block blockPointer, return -1 if it is in use
+int allocateBlockAt(int blockPointer) {
+  struct super_block *superblock = (struct super_block *)ramdisk;
+  unsigned char *block_bitmap = getBitmap();
+  int mask = 1 << (blockPointer % 8);
+
+  if ((block_bitmap[blockPointer / 8] & mask) == 0) {
+    return -1;
+  }
+  block_bitmap[blockPointer / 8] &= ~mask;
+  superblock->freeBlocks--;
+
+  return blockPointer;
+}
+
+//lz4 state lives outside the ramdisk, no chunk is cached yet
+int initCompression() {
+    compressWorkspace = vmalloc(LZ4_MEM_COMPRESS);
+    if (NULL == compressWorkspace) {
+      return -1;
+    }
+    memset(chunkCache, 0, sizeof(chunkCache));
+    chunkCacheNext = 0;
+
+    return 0;
+}
+
 //uses bitmap to allocate one empty block
 int allocateOneBlock() {
   int index = 0;
-  int block_ptr = 0;
-  unsigned char check = 0;
-  superblock *superblock = NULL;
+  int blockPointer = 0;
+  struct super_block *superblock = NULL;
   unsigned char *block_bitmap = NULL;
 
-  superblock = (superblock *)ramdisk;
+  superblock = (struct super_block *)ramdisk;
   block_bitmap = (ramdisk + BLOCK_SIZE * (1 + INODE_ARRAY_BLK_COUNT));
 
   for(int i = 0; i < BITMAP_BLK_COUNT; i++) {
 
     for(int j = 0; j < BLOCK_SIZE; j++) {
-      check = 1;
+      unsigned char mask = 1;
 
       for(int g = 0; g < 8; g++) {
 
@@ -96,6 +299,12 @@ int allocateOneBlock() {
       index++;
     }
   }
+
+  // out of blocks, take back the ones still waiting to be reclaimed
+  if (deferredFreeCount > 0) {
+    reclaimAllDeferredBlocks();
+    return allocateOneBlock();
+  }
   return -1;
 }
 
@@ -104,16 +313,85 @@ int allocateOneBlock() {
 //remove from memory
 void uninitialize()
 {
+    vfree(openFileTable);
+    openFileTable = NULL;
+    vfree(compressWorkspace);
+    compressWorkspace = NULL;
+#ifdef RD_USERSPACE
+    if (ramdiskMapped) {
+      reclaimAllDeferredBlocks();
+      msync(ramdisk, RD_MEM_CAP, MS_SYNC);
+      munmap(ramdisk, RD_MEM_CAP);
+      ramdiskMapped = 0;
+      ramdisk = NULL;
+      return;
+    }
+#endif
     vfree(ramdisk);
     ramdisk = NULL;
 }
 
 
+// take an open file slot for inodeNum positioned at 0, return its handle or -1 if none
+int allocateOpenFile(int inodeNum)
+{
+  if (-1 == openFileFreeList) {
+    return -1;
+  }
+
+  int handle = openFileFreeList;
+  struct open_file *openFile = &openFileTable[handle];
+  openFileFreeList = openFile->nextFree;
+
+  openFile->inUse = 1;
+  openFile->nextFree = -1;
+  openFileCount++;
+  openFile->inodeNum = inodeNum;
+  openFile->indexNode = getINode(inodeNum);
+  initFilePosn(&openFile->filePosition, openFile->indexNode, 0, 1);
+  openFile->nextSeqPosition = 0;
+  openFile->seqReads = 0;
+  openFile->raFirstBlock = 0;
+  openFile->raCount = 0;
+  openFile->dirPosition = 0;
+  openFile->dirBlock = 0;
+
+  return handle;
+}
+
+// return open file for handle, NULL if handle is not open
+struct open_file *getOpenFile(int handle)
+{
+  if ((handle < 0) || (handle >= MAX_OPEN_FILES) || !openFileTable[handle].inUse) {
+    return NULL;
+  }
+  return &openFileTable[handle];
+}
+
+// put open file slot back on the free list
+void freeOpenFile(int handle)
+{
+  struct open_file *openFile = &openFileTable[handle];
+  openFile->inUse = 0;
+  openFile->indexNode = NULL;
+  openFile->nextFree = openFileFreeList;
+  openFileFreeList = handle;
+  openFileCount--;
+}
+
+
 // return address of inode at inodeNum
+// check if inodeNum names a slot of the inode array or the root
+// lookups running without the ioctl lock can read an entry mid update and must not follow it further
+int isValidINodeNum(int inodeNum)
+{
+  return (inodeNum >= 0) && (inodeNum <= MAX_INODES);
+}
+
 struct inode *getINode(int inodeNum)
 {
   if (inodeNum <= 0) { // root inode
-    struct super_block *superblock = (superblock *)ramdisk;
+    struct super_block *superblock = (struct super_block *)ramdisk;
     return &superblock->first;
   }
   
@@ -127,20 +405,244 @@ unsigned char *getBitmap()
   return (ramdisk + BLOCK_SIZE * (1 + INODE_ARRAY_BLK_COUNT));
 }
 
+// return mem address of the share counts, entry n counts the extra holders of block n
+unsigned short *getBlockShares()
+{
+  return (unsigned short *)(ramdisk + BLOCK_SIZE * (1 + INODE_ARRAY_BLK_COUNT + BITMAP_BLK_COUNT));
+}
+
+// check if more than one inode or table references block
+int isBlockShared(int blockPointer)
+{
+  return getBlockShares()[blockPointer] > 0;
+}
+
+// add a holder to block, return -1 if its share count is saturated
+int shareBlock(int blockPointer)
+{
+  unsigned short *shares = getBlockShares();
+  if (MAX_BLOCK_SHARES == shares[blockPointer]) {
+    return -1;
+  }
+  shares[blockPointer]++;
+  return 0;
+}
+
 // return address of block at block_ptr
 char *getBlockAddress(int blockPointer)
 {
-  return (ramdisk + (BLOCK_SIZE * blockPointer));
+  return (char *)(ramdisk + (BLOCK_SIZE * blockPointer));
 }
 
-// find dir index node for specified pathname
-struct inode* getDirIndexNode(const char *pathname)
+// check bitmap if block is allocated
+int isBlockUsed(int blockPointer)
 {
-  struct inode *current_node = &(superblock *)ramdisk->first;
+  unsigned char *block_bitmap = getBitmap();
+  return (block_bitmap[blockPointer / 8] & (1 << (blockPointer % 8))) == 0;
+}
 
-  // Skip leading '/'
+//resolve a whole path to its inode number, root is 0, -1 if anything along it is missing
+int getPathINodeNum(const char *pathname)
+{
+  if ((0 == strcmp("", pathname)) || (0 == strcmp("/", pathname)))
+  {
+    return 0;
+  }
+
+  struct inode *parent = getDirIndexNode(pathname);
+  if (NULL == parent)
+  {
+    return -1;
+  }
+  struct directory_entry *entry = getDirectory(parent, UsingPathGetFileName(pathname), NULL);
+  if ((NULL == entry) || !isValidINodeNum(entry->inodeNum))
+  {
+    return -1;
+  }
+  return entry->inodeNum;
+}
+
+//count the blocks referenced from a block pointer table and the table itself
+int countTableBlocks(int blockPointer, int depth)
+{
+  if ((blockPointer <= 0) || (blockPointer >= TOTAL_BLK_COUNT))
+  {
+    return 0;
+  }
+
+  int count = 1;
+  int *table = (int *)getBlockAddress(blockPointer);
+  for (int i = 0; i < PTR_PER_BLOCK; i++)
+  {
+    if (depth > 1)
+    {
+      count = count + countTableBlocks(table[i], depth - 1);
+    }
+    else if (table[i] > 0)
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+//1 if data block block doesn't follow on from prev and so starts an extent, prev moves on to it
+//holes and compressed length markers start nothing
+int countExtentBlock(int block, int *prev)
+{
+  if ((block <= 0) || (block >= TOTAL_BLK_COUNT))
+  {
+    return 0;
+  }
+
+  int starts = (block != *prev + 1);
+  *prev = block;
+  return starts;
+}
+
+//count the extents the data blocks referenced from a block pointer table start, prev carries
+//the last data block seen across tables
+int countTableExtents(int blockPointer, int depth, int *prev)
+{
+  if ((blockPointer <= 0) || (blockPointer >= TOTAL_BLK_COUNT))
+  {
+    return 0;
+  }
+
+  int extents = 0;
+  int *table = (int *)getBlockAddress(blockPointer);
+  for (int i = 0; i < PTR_PER_BLOCK; i++)
+  {
+    if (depth > 1)
+    {
+      extents = extents + countTableExtents(table[i], depth - 1, prev);
+    }
+    else
+    {
+      extents = extents + countExtentBlock(table[i], prev);
+    }
+  }
+  return extents;
+}
+
+//count the runs of consecutive blocks the data of indexNode is stored in, in file order
+int countExtents(struct inode *indexNode)
+{
+  int prev = -1;
+  int extents = 0;
+
+  if (indexNode->flags & INODE_INLINE_DATA)
+  {
+    return 0;
+  }
+  for (int i = 0; i < TOTAL_DIRECT_BLK_PTRS; i++)
+  {
+    extents = extents + countExtentBlock(indexNode->location[i], &prev);
+  }
+  extents = extents + countTableExtents(indexNode->location[SINGLE_INDIR_LOC], 1, &prev);
+  extents = extents + countTableExtents(indexNode->location[DOUBLE_INDIR_LOC], 2, &prev);
+
+  return extents;
+}
+
+//fill stat with the attributes of inode inodeNum
+void fillStat(int inodeNum, struct rd_stat *stat)
+{
+  struct inode *indexNode = getINode(inodeNum);
+
+  stat->inodeNum = inodeNum;
+  stat->generation = indexNode->generation;
+  stat->type = indexNode->type;
+  stat->size = indexNode->size;
+  stat->linkCount = indexNode->linkCount;
+  stat->openCount = indexNode->filesOpen;
+  stat->flags = indexNode->flags & INODE_USER_FLAGS;
+  stat->blocks = 0;
+  stat->extents = countExtents(indexNode);
+
+  if (indexNode->flags & INODE_INLINE_DATA)
+  {
+    return;
+  }
+  for (int i = 0; i < TOTAL_DIRECT_BLK_PTRS; i++)
+  {
+    if (indexNode->location[i] > 0)
+    {
+      stat->blocks++;
+    }
+  }
+  stat->blocks = stat->blocks + countTableBlocks(indexNode->location[SINGLE_INDIR_LOC], 1);
+  stat->blocks = stat->blocks + countTableBlocks(indexNode->location[DOUBLE_INDIR_LOC], 2);
+}
+
+// find the next run of allocated blocks at or after from, return its start or -1 if none
+int nextUsedExtent(int from, int *count)
+{
+  int start = from;
+  while ((start < TOTAL_BLK_COUNT) && !isBlockUsed(start)) {
+    start++;
+  }
+  if (start >= TOTAL_BLK_COUNT) {
+    return -1;
+  }
+
+  int end = start;
+  while ((end < TOTAL_BLK_COUNT) && isBlockUsed(end)) {
+    end++;
+  }
+  *count = end - start;
+
+  return start;
+}
+
+// find the next run of free blocks at or after from, return its start or -1 if none
+int nextFreeExtent(int from, int *count)
+{
+  int start = from;
+  while ((start < TOTAL_BLK_COUNT) && isBlockUsed(start)) {
+    start++;
+  }
+  if (start >= TOTAL_BLK_COUNT) {
+    return -1;
+  }
+
+  int end = start;
+  while ((end < TOTAL_BLK_COUNT) && !isBlockUsed(end)) {
+    end++;
+  }
+  *count = end - start;
+
+  return start;
+}
+
+// fill report with the free extents of the ramdisk bucketed by size
+void fillFragReport(struct rd_frag_report *report)
+{
+  int count = 0;
+
+  memset(report, 0, sizeof(struct rd_frag_report));
+  report->totalBlocks = TOTAL_BLK_COUNT;
+  for (int start = nextFreeExtent(META_BLK_COUNT, &count); start >= 0; start = nextFreeExtent(start + count, &count)) {
+    int bucket = 0;
+    while ((bucket < (RD_FRAG_BUCKETS - 1)) && ((count >> (bucket + 1)) > 0)) {
+      bucket++;
+    }
+    report->freeExtentHistogram[bucket]++;
+    report->freeExtents++;
+    report->freeBlocks = report->freeBlocks + count;
+    report->largestFreeExtent = (count > report->largestFreeExtent) ? count : report->largestFreeExtent;
+  }
+}
+
+// find dir index node for specified pathname, a relative pathname is resolved from directory start
+struct inode* getDirIndexNodeAt(struct inode *start, const char *pathname)
+{
+  struct inode *current_node = start;
+
+  // absolute paths start at the root whatever start is
   if (pathname[0] == '/')
   {
+    current_node = getINode(0);
     pathname++;
   }
 
@@ -159,8 +661,8 @@ struct inode* getDirIndexNode(const char *pathname)
 
     struct directory_entry *current_entry = getDirectory(current_node, segment_start, segment_end);
 
-    // Child directory entry not found
-    if (current_entry == NULL)
+    // Child directory entry not found, or torn under a lockless reader
+    if ((current_entry == NULL) || !isValidINodeNum(current_entry->inodeNum))
     {
       return NULL;
     }
@@ -168,7 +670,7 @@ struct inode* getDirIndexNode(const char *pathname)
     current_node = getINode(current_entry->inodeNum);
 
     // Not a directory
-    if (strcmp(current_node->type, "dir") != 0)
+    if (dirINodeType != current_node->type)
     {
       return NULL;
     }
@@ -178,6 +680,52 @@ struct inode* getDirIndexNode(const char *pathname)
 }
 
 
+// find dir index node for specified pathname
+struct inode* getDirIndexNode(const char *pathname)
+{
+  return getDirIndexNodeAt(getINode(0), pathname);
+}
+
+// check if the directories leading to the last name of pathname include indexNode
+int pathPassesThrough(const char *pathname, struct inode *indexNode)
+{
+  struct super_block *superblock = (struct super_block *)ramdisk;
+  struct inode *current_node = &superblock->first;
+
+  // Skip leading '/'
+  if (pathname[0] == '/')
+  {
+    pathname++;
+  }
+
+  const char *segment_start = pathname;
+  const char *segment_end;
+
+  for (;; segment_start = segment_end + 1)
+  {
+    if (current_node == indexNode)
+    {
+      return 1;
+    }
+
+    segment_end = getNextDir(segment_start);
+    if (segment_end == NULL)
+    {
+      break;
+    }
+
+    struct directory_entry *current_entry = getDirectory(current_node, segment_start, segment_end);
+    if (current_entry == NULL)
+    {
+      return 0;
+    }
+    current_node = getINode(current_entry->inodeNum);
+  }
+
+  return 0;
+}
+
+
 //using a defined absolute path, get the next directory referenced
 static const char* getNextDir(const char* path) {
     const char* current = path;
@@ -197,96 +745,329 @@ static const char* getNextDir(const char* path) {
 
 
 
-// find child directory entry by its name
-struct directory_entry *getDirectory(struct inode *indexNode, const char *fnameStart, const char *fnameEnd)
+// find child directory entry by its name and store its offset at entryPos if not NULL,
+// fnameEnd NULL means the name runs to the end of the string
+struct directory_entry *findDirEntry(struct inode *indexNode, const char *fnameStart, const char *fnameEnd, int *entryPos)
 {
+  int nameLen = (NULL == fnameEnd) ? (int)strlen(fnameStart) : (int)(fnameEnd - fnameStart);
+
+  // entries never straddle a block, or the inline area of an inline directory
+  int spanLen = (indexNode->flags & INODE_INLINE_DATA) ? INODE_INLINE_CAP : BLOCK_SIZE;
 
   struct file_posn filePosition;
   initFilePosn(&filePosition, indexNode, 0, 1);
 
   while (filePosition.filePosition < indexNode->size) { // iterate thru directory file to the end
     struct directory_entry *entry = (struct directory_entry *)getMemAddress(&filePosition);
-    if (NULL == entry) {
+    if ((NULL == entry) || (0 == entry->recordLen)) {
       break;
     }
 
-    filePosnAdjust(&filePosition, sizeof(struct directory_entry)); // add fild posn by size of directory entry
+    int pos = filePosition.filePosition;
+    filePosnAdjust(&filePosition, entry->recordLen); // skip to the next entry
 
-    if (NULL == fnameEnd) { // if directory found with same name, return
-      if (0 == strcmp(fnameStart, entry->filename)) {
-        return entry;
-      }
-    } else {
-      if (0 == strncmp(entry->filename, fnameStart, fnameEnd)) {
-        return entry;
+    // a lookup without rdLock can read a nameLen torn by a writer, never compare past the span
+    int entryNameLen = entry->nameLen;
+    if (((pos % spanLen) + (int)sizeof(struct directory_entry) + entryNameLen) > spanLen) {
+      break;
+    }
+
+    // if directory found with same name, return
+    if ((entryNameLen == nameLen) && (0 == memcmp(entry->filename, fnameStart, nameLen))) {
+      if (NULL != entryPos) {
+        *entryPos = pos;
       }
+      return entry;
     }
   }
 
   return NULL;
 }
 
-//used a defined absolute path, get a specific filename
-const char* UsingPathGetFileName(const char* pathname)
+// find child directory entry by its name, fnameEnd NULL means the name runs to the end of the string
+struct directory_entry *getDirectory(struct inode *indexNode, const char *fnameStart, const char *fnameEnd)
 {
-    // find the last occurrence of '/'
-    const char* lastSlash = strrchr(pathname, '/');
-
-    // set fnameStart accordingly
-    const char* fnameStart = (lastSlash != NULL) ? (lastSlash + 1) : pathname;
-
-    return fnameStart;
+  return findDirEntry(indexNode, fnameStart, fnameEnd, NULL);
 }
 
-void freeINodeMem(struct inode *indexNode)
+// bucket of the batch name index to start probing at for name
+int batchNameBucket(const char *name, int nameLen)
 {
-  int blockVal = 0;
-  int *indirectLoc = NULL;
-  struct blk_ptr blockPointer;
+  unsigned int hash = 2166136261u;
 
-  initBlockPtr(&blockPointer, indexNode, 0, 1);
-
-  // Free direct and indirect blocks
-  for (int i = 0; i < MAX_BLOCK_COUNT_IN_FILE; i++)
+  for (int i = 0; i < nameLen; i++)
   {
-    blockVal = getBlkPtr(&blockPointer);
-    if (blockVal <= 0)
-    {
+    hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+  }
+  return (int)((hash ^ (hash >> 15)) & (BATCH_NAME_BUCKETS - 1));
+}
+
+// batch position of name, -1 if no batch name up to count matches
+int findBatchName(const char *name, int nameLen, int count)
+{
+  for (int b = batchNameBucket(name, nameLen); 0 != batchNameIndex[b]; b = (b + 1) & (BATCH_NAME_BUCKETS - 1))
+  {
+    int i = batchNameIndex[b] - 1;
+    if ((i < count) && (batchNameLens[i] == nameLen) && (0 == memcmp(batchNames[i], name, nameLen)))
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// take up to count NUL terminated names packed in namesLen bytes at names into the batch, return how many
+// stops at a name running past the buffer or holding a '/', past MAX_INODES names the inodes have run out anyway
+int loadBatchNames(const char *names, int namesLen, int count)
+{
+  int batchLen = 0;
+  int pos = 0;
+
+  while ((batchLen < count) && (batchLen < MAX_INODES) && (pos < namesLen))
+  {
+    const char *name = names + pos;
+    const char *nameEnd = memchr(name, '\0', namesLen - pos);
+    if ((NULL == nameEnd) || (NULL != strchr(name, '/')))
+    {
+      break;
+    }
+    batchNames[batchLen] = name;
+    batchNameLens[batchLen] = (int)(nameEnd - name);
+    batchLen++;
+    pos = pos + batchNameLens[batchLen - 1] + 1;
+  }
+  return batchLen;
+}
+
+// index the first count names of batchNames, return the position of the first repeated name, count if none
+int indexBatchNames(int count)
+{
+  memset(batchNameIndex, 0, sizeof(batchNameIndex));
+
+  for (int i = 0; i < count; i++)
+  {
+    if (-1 != findBatchName(batchNames[i], batchNameLens[i], i))
+    {
+      return i;
+    }
+    int b = batchNameBucket(batchNames[i], batchNameLens[i]);
+    while (0 != batchNameIndex[b])
+    {
+      b = (b + 1) & (BATCH_NAME_BUCKETS - 1);
+    }
+    batchNameIndex[b] = (short)(i + 1);
+  }
+  return count;
+}
+
+// lowest position among the first count indexed batch names of a name indexNode already holds,
+// count if none, the directory is read once whatever the batch size
+int firstBatchNameInDir(struct inode *indexNode, int count)
+{
+  struct file_posn filePosition;
+  initFilePosn(&filePosition, indexNode, 0, 1);
+
+  while ((count > 0) && (filePosition.filePosition < indexNode->size))
+  {
+    struct directory_entry *entry = (struct directory_entry *)getMemAddress(&filePosition);
+    if ((NULL == entry) || (0 == entry->recordLen))
+    {
       break;
     }
-    freeBlock(blockVal);
-    blockPtrIncrease(&blockPointer);
+    filePosnAdjust(&filePosition, entry->recordLen);
+
+    if (0 != entry->nameLen)
+    {
+      int i = findBatchName(entry->filename, entry->nameLen, count);
+      if (-1 != i)
+      {
+        count = i;
+      }
+    }
   }
+  return count;
+}
+
+//used a defined absolute path, get a specific filename
+const char* UsingPathGetFileName(const char* pathname)
+{
+    // find the last occurrence of '/'
+    const char* lastSlash = strrchr(pathname, '/');
+
+    // set fnameStart accordingly
+    const char* fnameStart = (lastSlash != NULL) ? (lastSlash + 1) : pathname;
 
-  // Free single indirect block
-  if (indexNode->location[TOTAL_SINGLE_INDIR_BLK_PTRS] > 0)
+    return fnameStart;
+}
+
+//release an indirect table and the blocks it points to, depth 2 for the double indirect table
+//a table still shared with a clone only drops this reference, its blocks stay with the other holders
+void freeIndirectTable(int blockPointer, int depth)
+{
+  if (blockPointer <= 0)
   {
-    freeBlock(indexNode->location[TOTAL_SINGLE_INDIR_BLK_PTRS]);
+    return;
   }
 
-  // Free double indirect blocks
-  if (indexNode->location[TOTAL_DOUBLE_INDIR_BLK_PTRS] > 0)
+  if (!isBlockShared(blockPointer))
   {
-    indirectLoc = (int *)getBlockAddress(indexNode->location[TOTAL_DOUBLE_INDIR_BLK_PTRS]);
-    for (i = 0; i < PTR_PER_BLOCK; i++)
+    int *table = (int *)getBlockAddress(blockPointer);
+    for (int i = 0; i < PTR_PER_BLOCK; i++)
     {
-      if (indirectLoc[i] <= 0)
+      if (table[i] <= 0)
       {
-        break;
+        continue;
+      }
+      if (depth > 1)
+      {
+        freeIndirectTable(table[i], depth - 1);
+        continue;
+      }
+
+      // consecutive block numbers go back as one run
+      int run = 1;
+      while (((i + run) < PTR_PER_BLOCK) && (table[i + run] == table[i] + run))
+      {
+        run++;
       }
-      freeBlock(indirectLoc[i]);
+      freeBlockRun(table[i], run);
+      i = i + run - 1;
+    }
+  }
+  freeBlock(blockPointer);
+}
+
+void freeINodeMem(struct inode *indexNode)
+{
+  // inline contents own no blocks
+  if (indexNode->flags & INODE_INLINE_DATA)
+  {
+    memset(indexNode->inlineData, 0, INODE_INLINE_CAP);
+    indexNode->size = 0;
+    indexNode->dirCount = 0;
+    indexNode->dirTombstones = 0;
+    indexNode->dirFreeHint = 0;
+    return;
+  }
+
+  // Free direct blocks
+  for (int i = 0; i < TOTAL_DIRECT_BLK_PTRS; i++)
+  {
+    if (indexNode->location[i] > 0)
+    {
+      freeBlock(indexNode->location[i]);
     }
-    freeBlock(indexNode->location[TOTAL_DOUBLE_INDIR_BLK_PTRS]);
   }
 
+  // Free single and double indirect tables with their blocks
+  freeIndirectTable(indexNode->location[SINGLE_INDIR_LOC], 1);
+  freeIndirectTable(indexNode->location[DOUBLE_INDIR_LOC], 2);
+
   // Reset locations and size
-  for (i = 0; i < 10; i++)
+  for (int i = 0; i < LOCATION_COUNT; i++)
   {
     indexNode->location[i] = 0;
   }
 
   indexNode->size = 0;
   indexNode->dirCount = 0;
+  indexNode->dirTombstones = 0;
+  indexNode->dirFreeHint = 0;
+
+  // an emptied inode goes back to inline storage
+  indexNode->flags |= INODE_INLINE_DATA;
+}
+
+// release an unlinked inode in constant time, one with block pointer tables is queued for
+// reclaimDeferredBlocks and stays reserved until its blocks are gone, the rest are freed on the spot
+void releaseINodeDeferred(struct inode *indexNode)
+{
+  if ((indexNode->flags & INODE_INLINE_DATA) ||
+      ((indexNode->location[SINGLE_INDIR_LOC] <= 0) && (indexNode->location[DOUBLE_INDIR_LOC] <= 0)))
+  {
+    freeINodeMem(indexNode);
+    releaseINode(indexNode);
+    return;
+  }
+
+  indexNode->type = reclaimINodeType;
+  indexNode->linkCount = 0;
+  deferredFree[(deferredFreeHead + deferredFreeCount) % MAX_INODES] = (int)(indexNode - getINode(1)) + 1;
+  deferredFreeCount++;
+}
+
+// free one step of the blocks location[] points to, the direct blocks and the single indirect table
+// first, then the double indirect table a row at a time, returns 0 once nothing is left
+int reclaimLocation(int *location)
+{
+  for (int i = 0; i < TOTAL_DIRECT_BLK_PTRS; i++)
+  {
+    if (location[i] > 0)
+    {
+      freeBlock(location[i]);
+      location[i] = 0;
+    }
+  }
+
+  if (location[SINGLE_INDIR_LOC] > 0)
+  {
+    freeIndirectTable(location[SINGLE_INDIR_LOC], 1);
+    location[SINGLE_INDIR_LOC] = 0;
+    return location[DOUBLE_INDIR_LOC] > 0;
+  }
+
+  int doubleTable = location[DOUBLE_INDIR_LOC];
+  if (doubleTable <= 0)
+  {
+    return 0;
+  }
+
+  // a table still shared with a clone only drops this reference
+  if (!isBlockShared(doubleTable))
+  {
+    int *table = (int *)getBlockAddress(doubleTable);
+    for (int i = 0; i < PTR_PER_BLOCK; i++)
+    {
+      if (table[i] > 0)
+      {
+        freeIndirectTable(table[i], 1);
+        table[i] = 0;
+        return 1;
+      }
+    }
+  }
+  freeBlock(doubleTable);
+  location[DOUBLE_INDIR_LOC] = 0;
+
+  return 0;
+}
+
+// run up to steps reclaim steps on the deferred inodes, oldest first, each step frees at most
+// one block pointer table and the blocks under it, an inode is released once it has no blocks left
+// returns non zero while blocks remain deferred
+int reclaimDeferredBlocks(int steps)
+{
+  while ((steps > 0) && (deferredFreeCount > 0))
+  {
+    struct inode *indexNode = getINode(deferredFree[deferredFreeHead]);
+    if (0 == reclaimLocation(indexNode->location))
+    {
+      releaseINode(indexNode);
+      deferredFreeHead = (deferredFreeHead + 1) % MAX_INODES;
+      deferredFreeCount--;
+    }
+    steps--;
+  }
+
+  return deferredFreeCount > 0;
+}
+
+// free every deferred block now
+void reclaimAllDeferredBlocks()
+{
+  while (reclaimDeferredBlocks(MAX_INODES))
+  {
+  }
 }
 
 
@@ -294,14 +1075,19 @@ void freeINodeMem(struct inode *indexNode)
 int getAvailableNode() {
     struct inode *indexNode_array = NULL;
 
-    struct super_block *superblock = (superblock *)ramdisk;
+    struct super_block *superblock = (struct super_block *)ramdisk;
+
+    // out of inodes, finish reclaiming the oldest unlinked ones until one is free
+    while ((superblock->freeINodes <= 0) && (deferredFreeCount > 0)) {
+        reclaimDeferredBlocks(1);
+    }
     if (superblock->freeINodes <= 0) return -1; // check for free inodes
 
     indexNode_array = getINode(1);
 
     for (int i = 0; i < MAX_INODES; i++) {
-        // empty string == available node
-        if (indexNode_array[i].type[0] == '\0') {
+        // unused type == available node
+        if (unusedINodeType == indexNode_array[i].type) {
             superblock->freeINodes--;
             return (i + 1);
         }
@@ -310,46 +1096,51 @@ int getAvailableNode() {
     return -1; // no node found
 }
 
-// find empty child directory entry under parent
-struct directory_entry *findEmptyDirEntry(struct inode *indexNode)
+// find empty child directory entry under parent with room for recordLen bytes
+// the scan starts at the free slot hint and moves the hint up to the first empty slot it passes
+struct directory_entry *findEmptyDirEntry(struct inode *indexNode, int recordLen)
 {
   struct directory_entry *entry = NULL;
   struct file_posn filePosition;
+  int firstEmpty = -1;
 
-  initFilePosn(&filePosition, indexNode, 0, 1);
+  if (0 == indexNode->dirTombstones)
+  {
+    return NULL;
+  }
+
+  initFilePosn(&filePosition, indexNode, indexNode->dirFreeHint, 1);
 
   while (filePosition.filePosition < indexNode->size) // iterate thru directory file to the end
   {
     entry = (struct directory_entry *)getMemAddress(&filePosition);
-    if (NULL == entry)
+    if ((NULL == entry) || (0 == entry->recordLen))
     {
       break;
     }
 
-    filePosnAdjust(&filePosition, sizeof(struct directory_entry)); // add fild posn by size of directory entry
+    int pos = filePosition.filePosition;
+    filePosnAdjust(&filePosition, entry->recordLen); // skip to the next entry
 
-    if (0 == strcmp(entry->filename, "")) // return if empty directory found
+    if (0 != entry->nameLen)
+    {
+      continue;
+    }
+    if (-1 == firstEmpty)
+    {
+      firstEmpty = pos;
+    }
+    if (entry->recordLen >= recordLen) // return if big enough empty slot found
     {
+      indexNode->dirFreeHint = firstEmpty;
       return entry;
     }
   }
 
+  indexNode->dirFreeHint = (-1 == firstEmpty) ? indexNode->size : firstEmpty;
   return NULL;
 }
 
-//use file position object to get the respective memory address corresponding to it
-char *getMemAddress(struct file_posn *filePosition)
-{
-  //gets block pointer value from file position block pointer ref
-  int blockPtrValue = getBlockPtrValue(&filePosn->blockPointer);
-  if (blockPtrValue <= 0)
-  {
-    return NULL;
-  }
-  return getBlockAddress(blockPtrValue) + filePosn->dataBlockOffset;
-}
-
-
 //allocate free block and clear mem to zero, return -1 if none
 int clearAllocateBlock() {
     int blockPointer = allocateOneBlock();
@@ -361,278 +1152,1260 @@ int clearAllocateBlock() {
     return blockPointer;
 }
 
-// sets used block to free, frees to the list
+// drops one holder of the block, sets it free and returns it to the list once nobody holds it
 void freeBlock(int blockPointer) {
     int index = blockPointer / 8;
     int k = blockPointer % 8;
     int mask = 1 << k;
 
-    struct super_block *superblock = (superblock *)ramdisk;
+    struct super_block *superblock = (struct super_block *)ramdisk;
     unsigned char *block_bitmap = getBitmap();
+    unsigned short *shares = getBlockShares();
+
+    // shared block, the other holders keep it
+    if (shares[blockPointer] > 0) {
+        shares[blockPointer]--;
+        return;
+    }
 
     // if bitmap mask bit of the corresponding block is 0, set it to 1
     if ((block_bitmap[index] & mask) == 0) {
+        dedupIndexed[index] &= ~mask; // may come back as a table or directory block
         block_bitmap[index] |= mask;
         superblock->freeBlocks++;
+        blockMapGeneration++;
+    }
+}
+
+// free count consecutive blocks from blockPointer, a whole bitmap byte at a time where the run
+// covers it and none of its blocks is shared
+void freeBlockRun(int blockPointer, int count) {
+    int end = blockPointer + count;
+
+    struct super_block *superblock = (struct super_block *)ramdisk;
+    unsigned char *block_bitmap = getBitmap();
+    unsigned short *shares = getBlockShares();
+
+    while (blockPointer < end) {
+        int index = blockPointer / 8;
+        if ((0 == blockPointer % 8) && ((blockPointer + 8) <= end) && (0 == block_bitmap[index]) &&
+            (NULL == memchr_inv(&shares[blockPointer], 0, 8 * sizeof(unsigned short)))) {
+            dedupIndexed[index] = 0;
+            block_bitmap[index] = 0xFF;
+            superblock->freeBlocks += 8;
+            blockMapGeneration++;
+            blockPointer += 8;
+            continue;
+        }
+        freeBlock(blockPointer);
+        blockPointer++;
     }
 }
 
 
-// add directory entry to specified parent directory
-int addToParentDir(struct inode *indexNode, struct directory_entry *entry)
+// grow directory file by an empty slot of recordLen bytes, return NULL if no space
+struct directory_entry *appendDirEntry(struct inode *indexNode, int recordLen)
 {
-  // if empty directory in dir file inode, use it for the inode & return
-  if ((indexNode->dirCount * sizeof(struct directory_entry)) < ((unsigned int)indexNode->size))
+  struct directory_entry *entry = NULL;
+  int pos = indexNode->size;
+
+  // small directories stay inside the inode
+  if (indexNode->flags & INODE_INLINE_DATA)
   {
-    memcpy(findEmptyDirEntry(indexNode), entry, sizeof(struct directory_entry));
-    indexNode->dirCount++;
-    return 0;
+    if ((pos + recordLen) <= INODE_INLINE_CAP)
+    {
+      entry = (struct directory_entry *)(indexNode->inlineData + pos);
+      memset(entry, 0, recordLen);
+      entry->recordLen = recordLen;
+      indexNode->size = pos + recordLen;
+      return entry;
+    }
+    if (0 != migrateInlineData(indexNode))
+    {
+      return NULL;
+    }
   }
 
-  if ((indexNode->size + sizeof(struct directory_entry)) > MAX_FILE_SIZE) { // parent directory size exceeds max file size
-    return -1;
+  // entries never straddle a block, a short block tail becomes an empty slot
+  int padLen = BLOCK_SIZE - (pos % BLOCK_SIZE);
+  if (padLen >= recordLen)
+  {
+    padLen = 0;
+  }
+
+  if ((pos + padLen + recordLen) > MAX_FILE_SIZE) { // parent directory size exceeds max file size
+    return NULL;
   }
   struct file_posn filePosition;
-  initFilePosn(&filePosition, indexNode, indexNode->size, 0);
-  char *availablePosn = getMemAddress(&filePosition);
-  if (NULL == availablePosn) { // check if available space
-    return -1;
+  initFilePosn(&filePosition, indexNode, pos + padLen, 0);
+  entry = (struct directory_entry *)getMemAddress(&filePosition);
+  if (NULL == entry) { // check if available space
+    return NULL;
   }
-  // add dir to end of parent directory file
-  memcpy(availablePosn, entry, sizeof(struct directory_entry));
-  indexNode->size = indexNode->size + sizeof(struct directory_entry);
-  indexNode->dirCount++;
-
-  return 0;
-}
 
-
-
-//use file position object to get the respective memory address corresponding to it
-char *getMemAddress(struct file_posn *filePosition)
-{
-  //gets block pointer value from file position block pointer ref
-  int blockPtrValue = getBlockPtrValue(&filePosn->blockPointer);
-  if (blockPtrValue <= 0)
+  if (padLen > 0)
   {
-    return NULL;
+    initFilePosn(&filePosition, indexNode, pos, 1);
+    struct directory_entry *pad = (struct directory_entry *)getMemAddress(&filePosition);
+    memset(pad, 0, sizeof(struct directory_entry));
+    pad->recordLen = padLen;
+    if (indexNode->dirTombstones < MAX_DIR_ENTRIES)
+    {
+      indexNode->dirTombstones++;
+    }
   }
-  return getBlockAddress(blockPtrValue) + filePosn->dataBlockOffset;
-}
-
-// initialize file posn data struct
-void initFilePosn(struct file_posn *filePosition, struct inode *indexNode, int pos, int readOnly)
-{
-  int block_number = pos / BLOCK_SIZE;
-  filePosition->filePosition = pos;
 
-  //use blick number and pointer information to init block pointer
-  initBlockPtr(&filePosition->blockPointer,
-    indexNode,
-    block_number,
-    readOnly);
+  memset(entry, 0, recordLen);
+  entry->recordLen = recordLen;
+  indexNode->size = pos + padLen + recordLen;
 
-  //uses the position variable to offset the block data structure
-  filePosition->dataBlockOffset = pos % BLOCK_SIZE;
+  return entry;
 }
 
-//goes through and updates offset into file position and also into the block offset
-void filePosnAdjust(struct file_posn *filePosition, int offset)
+// add directory entry for filename to specified parent directory
+int addToParentDir(struct inode *indexNode, const char *filename, int inodeNum)
 {
-   // Updates file position and offset into data block
-  filePosn->filePosition = filePosn->filePosition + offset;
-  filePosn->dataBlockOffset = filePosn->dataBlockOffset + offset;
-
-  // Checks if the offset exceeds the block size, requiring an increase in block pointer
-  if (filePosn->dataBlockOffset >= BLOCK_SIZE)
-  {
-    increaseBlockPointer(&filePosn->blockPointer);
-    filePosn->dataBlockOffset = filePosn->dataBlockOffset - BLOCK_SIZE;
-  }
+  return addDirEntry(indexNode, filename, inodeNum, 1);
 }
 
-//primary function for initializing each of our block pointer data structures
-void initBlockPtr(struct blk_ptr*blockPointer, struct inode *indexNode, int block_number, int readOnly) {
-
-  //clear the block pointer structure
-  memset(blockPointer, 0, sizeof(blockPointer_t));
-  blockPointer->readOnly = readOnly;
-  blockPointer->indexNode = indexNode;
+// add directory entry for filename, reuseSlot 0 goes straight to the end of the directory file
+int addDirEntry(struct inode *indexNode, const char *filename, int inodeNum, int reuseSlot)
+{
+  int nameLen = strlen(filename);
+  int recordLen = DIR_ENTRY_LEN(nameLen);
 
-  //determine block pointer type based on the block numbers
-  if (block_number < dirBlkPtrCoUNT)
+  if (indexNode->dirCount >= MAX_DIR_ENTRIES)
   {
-    blockPointer->blkPtrType = directBlkPtr;
-    blockPointer->dirBlkPtr = block_number;
+    return -1;
   }
-  else if (block_number < (directBlkPtrS+ PTR_PER_BLOCK))
+
+  // if empty slot in dir file inode is big enough use it, else add to end of parent directory file
+  struct directory_entry *entry = reuseSlot ? findEmptyDirEntry(indexNode, recordLen) : NULL;
+  if (NULL != entry)
   {
-    blockPointer->blkPtrType = singleIndirectBlkPtr;
-    blockPointer->singleIndirBlkPtr = block_number - dirBlkPtrCoUNT;
+    indexNode->dirTombstones--;
   }
-  //need to use double indirect block pointers here
   else
   {
-    blockPointer->blkPtrType = doubleIndirectBlkPtr;
-    blockPointer->doubleIndirBlkPtrRow = (block_number - (directBlkPtrS+ PTR_PER_BLOCK)) / PTR_PER_BLOCK;
-    blockPointer->doubleIndirBlkPtrColumn = (block_number - (directBlkPtrS+ PTR_PER_BLOCK)) % PTR_PER_BLOCK;
+    entry = appendDirEntry(indexNode, recordLen);
+    if (NULL == entry)
+    {
+      return -1;
+    }
   }
+
+  // a reused slot keeps its recordLen
+  entry->inodeNum = inodeNum;
+  entry->nameLen = nameLen;
+  memcpy(entry->filename, filename, nameLen);
+  indexNode->dirCount++;
+
+  return 0;
 }
 
-//helper method whenever a specific block pointer might need to be increased because of the offset
-void blockPtrIncrease(struct blk_ptr*blockPointer)
+// zero an inode for reuse, its generation moves on so file handles to what it held go stale
+void resetINode(struct inode *indexNode)
 {
-  
-  //check to determine whether to increase direct block pointer
-  if (directBlkPtr == blockPointer->blkPtrType)
+  unsigned int generation = indexNode->generation;
+  memset(indexNode, 0, sizeof(struct inode));
+  indexNode->generation = generation + 1;
+}
+
+// return an inode taken by getAvailableNode to the unused pool
+void releaseINode(struct inode *indexNode)
+{
+  struct super_block *superblock = (struct super_block *)ramdisk;
+  resetINode(indexNode);
+  superblock->freeINodes++;
+}
+
+// point dst at the blocks of src, every block referenced from the inode gains a holder
+// tables are shared whole, so the blocks below them are only shared through the table
+int shareINodeBlocks(struct inode *dst, struct inode *src)
+{
+  dst->size = src->size;
+  dst->flags = src->flags;
+  memcpy(dst->inlineData, src->inlineData, INODE_INLINE_CAP); // union, covers location[] too
+
+  if (src->flags & INODE_INLINE_DATA)
   {
-    blockPointer->dirBlkPtr++;
-    
-    //if we are full with direct pointer, we need to start using single indirect
-    if (directBlkPtrS== blockPointer->dirBlkPtr)
-    {
-      blockPointer->blkPtrType = singleIndirectBlkPtr;
-      blockPointer->singleIndirBlkPtr = 0;
-    }
+    return 0;
   }
-  //check once again to determine whether or not to increase single indirect block pointer
-  else if (singleIndirectBlkPtr == blockPointer->blkPtrType)
-  {
-    blockPointer->singleIndirBlkPtr++;
 
-    //if single indirect full, need to move to double indirect
-    if (PTR_PER_BLOCK == blockPointer->singleIndirBlkPtr)
+  for (int i = 0; i < LOCATION_COUNT; i++)
+  {
+    if ((dst->location[i] > 0) && (0 != shareBlock(dst->location[i])))
     {
-      blockPointer->blkPtrType = doubleIndirectBlkPtr;
-      blockPointer->doubleIndirBlkPtrRow = 0;
-      blockPointer->doubleIndirBlkPtrColumn = 0;
-    }
-  }
-  
-  else if (doubleIndirectBlkPtr == blockPointer->blkPtrType)
-  {
-    blockPointer->doubleIndirBlkPtrColumn++;
-  
-    if (PTR_PER_BLOCK == blockPointer->doubleIndirBlkPtrColumn)
-    {
-      blockPointer->doubleIndirBlkPtrRow++;
-      blockPointer->doubleIndirBlkPtrColumn = 0;
+      // saturated, give back the holds taken so far
+      while (--i >= 0)
+      {
+        if (dst->location[i] > 0)
+        {
+          freeBlock(dst->location[i]);
+        }
+      }
+      memset(dst->location, 0, sizeof(dst->location));
+      dst->size = 0;
+      dst->flags = INODE_INLINE_DATA;
+      return -1;
     }
   }
+  //tables src walked for writing are shared now
+  blockMapGeneration++;
+
+  return 0;
 }
 
-//helps us with allocating the necessary required memory in blocks for our pointers to store data
-int getBlkPtr(struct blk_ptr*blockPointer)
+//give the holder of slot a private copy of a shared block, returns -1 if no memory
+//a copied table holds its own reference to every block it points to
+int copyOnWrite(int *slot, int isTable)
 {
-  int blockPointer_index = 0;
+  int blockPointer = allocateOneBlock();
+  if (blockPointer <= 0)
+  {
+    return -1;
+  }
+  memcpy(getBlockAddress(blockPointer), getBlockAddress(*slot), BLOCK_SIZE);
 
-  int *location = blockPointer->indexNode->location;
-  if (singleIndirectBlkPtr == blockPointer->blkPtrType)
+  if (isTable)
   {
-    
-    //allocate required memory if type is a single indirect block pointer
-    if (0 == location[TOTAL_SINGLE_INDIR_BLK_PTRS])
+    int *table = (int *)getBlockAddress(blockPointer);
+    for (int i = 0; i < PTR_PER_BLOCK; i++)
     {
-      //dont proceed further if someone is reading it
-      if (blockPointer->readOnly)
-      {
-        return -1;
-      }
-      else
+      if ((table[i] > 0) && (0 != shareBlock(table[i])))
       {
-        //fail if no more memory as well
-        location[TOTAL_SINGLE_INDIR_BLK_PTRS] = clearAllocateBlock();
-        if (location[TOTAL_SINGLE_INDIR_BLK_PTRS] <= 0)
+        while (--i >= 0)
         {
-          return -1;
+          if (table[i] > 0)
+          {
+            freeBlock(table[i]);
+          }
         }
+        freeBlock(blockPointer);
+        return -1;
       }
     }
-    location = (int *)getBlockAddress(location[TOTAL_SINGLE_INDIR_BLK_PTRS]);
   }
-  else if (doubleIndirectBlkPtr == blockPointer->blkPtrType)
+
+  freeBlock(*slot); // drops our hold on the original
+  *slot = blockPointer;
+  blockMapGeneration++;
+
+  return 0;
+}
+
+// release the blocks of a file from firstBlock up to blockCount, indirect tables left
+// without blocks go too, returns -1 if no memory to copy a table still shared with a clone
+int releaseBlocksFrom(struct inode *indexNode, int firstBlock, int blockCount)
+{
+  struct blk_ptr blockPointer;
+
+  // whole tables past firstBlock are dropped with everything below them
+  if (firstBlock <= TOTAL_DIRECT_BLK_PTRS + PTR_PER_BLOCK)
+  {
+    freeIndirectTable(indexNode->location[DOUBLE_INDIR_LOC], 2);
+    indexNode->location[DOUBLE_INDIR_LOC] = 0;
+    blockCount = (blockCount < TOTAL_DIRECT_BLK_PTRS + PTR_PER_BLOCK) ? blockCount : TOTAL_DIRECT_BLK_PTRS + PTR_PER_BLOCK;
+  }
+  if (firstBlock <= TOTAL_DIRECT_BLK_PTRS)
+  {
+    freeIndirectTable(indexNode->location[SINGLE_INDIR_LOC], 1);
+    indexNode->location[SINGLE_INDIR_LOC] = 0;
+    blockCount = (blockCount < TOTAL_DIRECT_BLK_PTRS) ? blockCount : TOTAL_DIRECT_BLK_PTRS;
+  }
+  blockMapGeneration++;
+
+  for (int i = firstBlock; i < blockCount; i++)
+  {
+    initBlockPtr(&blockPointer, indexNode, i, 0);
+    if (0 != punchBlock(&blockPointer))
+    {
+      return -1;
+    }
+  }
+
+  // rows of the double indirect table left with no blocks go too, then the table once every row is gone
+  int *doubleSlot = &indexNode->location[DOUBLE_INDIR_LOC];
+  if (*doubleSlot <= 0)
+  {
+    return 0;
+  }
+  int *rows = (int *)getBlockAddress(*doubleSlot);
+  for (int row = (firstBlock - TOTAL_DIRECT_BLK_PTRS - PTR_PER_BLOCK) / PTR_PER_BLOCK; row < PTR_PER_BLOCK; row++)
+  {
+    if ((rows[row] <= 0) || (NULL != memchr_inv(getBlockAddress(rows[row]), 0, BLOCK_SIZE)))
+    {
+      continue;
+    }
+
+    // a table still shared with a clone is copied before a row is dropped from it
+    rows = getIndirectTable(doubleSlot, 0);
+    if (NULL == rows)
+    {
+      return -1;
+    }
+    freeBlock(rows[row]);
+    rows[row] = 0;
+  }
+  if (NULL == memchr_inv(rows, 0, BLOCK_SIZE))
+  {
+    freeBlock(*doubleSlot);
+    *doubleSlot = 0;
+  }
+
+  return 0;
+}
+
+// rewrite the entries of a directory densely from offset 0 and release the blocks past them,
+// entries move so offsets held by readers go stale
+// returns -1 with the directory untouched if an entry can't be read or a block can't be written,
+// a shared block that can't be copied for lack of memory
+int compactDirectory(struct inode *indexNode)
+{
+  char record[BLOCK_SIZE];
+  int oldSize = indexNode->size;
+  int writePos = 0;
+  int padCount = 0;
+  int firstPad = -1;
+
+  struct file_posn readPosn;
+  struct file_posn writePosn;
+
+  // entries only move towards the start, so once every entry resolves for writing the moves below can't fail
+  initFilePosn(&writePosn, indexNode, 0, 0);
+  while (writePosn.filePosition < oldSize)
   {
+    struct directory_entry *entry = (struct directory_entry *)getMemAddress(&writePosn);
+    if ((NULL == entry) || (0 == entry->recordLen))
+    {
+      return -1;
+    }
+    filePosnAdjust(&writePosn, entry->recordLen);
+  }
+
+  initFilePosn(&readPosn, indexNode, 0, 1);
+
+  while (readPosn.filePosition < oldSize)
+  {
+    struct directory_entry *entry = (struct directory_entry *)getMemAddress(&readPosn);
+    filePosnAdjust(&readPosn, entry->recordLen);
+
+    if (0 == entry->nameLen)
+    {
+      continue;
+    }
+
+    // take a copy first, the destination may overlap entry
+    int nameLen = entry->nameLen;
+    int recordLen = DIR_ENTRY_LEN(nameLen);
+    memcpy(record, entry, sizeof(struct directory_entry) + nameLen);
+
+    // entries never straddle a block, a short block tail becomes an empty slot
+    int padLen = BLOCK_SIZE - (writePos % BLOCK_SIZE);
+    if (padLen < recordLen)
+    {
+      initFilePosn(&writePosn, indexNode, writePos, 0);
+      struct directory_entry *pad = (struct directory_entry *)getMemAddress(&writePosn);
+      memset(pad, 0, sizeof(struct directory_entry));
+      pad->recordLen = padLen;
+      firstPad = (-1 == firstPad) ? writePos : firstPad;
+      padCount++;
+      writePos = writePos + padLen;
+    }
+
+    // never past the entry being moved, so nothing unread is overwritten
+    initFilePosn(&writePosn, indexNode, writePos, 0);
+    struct directory_entry *dst = (struct directory_entry *)getMemAddress(&writePosn);
+    memset(dst, 0, recordLen);
+    memcpy(dst, record, sizeof(struct directory_entry) + nameLen);
+    dst->recordLen = recordLen;
+    writePos = writePos + recordLen;
+  }
+
+  indexNode->size = writePos;
+  indexNode->dirTombstones = padCount;
+  indexNode->dirFreeHint = (-1 == firstPad) ? writePos : firstPad;
+
+  if (indexNode->flags & INODE_INLINE_DATA)
+  {
+    return 0;
+  }
+
+  // small enough to move back inside the inode
+  if (writePos <= INODE_INLINE_CAP)
+  {
+    char data[INODE_INLINE_CAP];
+    int dirCount = indexNode->dirCount;
+    memcpy(data, getBlockAddress(indexNode->location[0]), writePos);
+    freeINodeMem(indexNode);
+    memcpy(indexNode->inlineData, data, writePos);
+    indexNode->size = writePos;
+    indexNode->dirCount = dirCount;
+    indexNode->dirFreeHint = writePos;
+    return 0;
+  }
+
+  releaseBlocksFrom(indexNode, (writePos + BLOCK_SIZE - 1) / BLOCK_SIZE, (oldSize + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+  return 0;
+}
+
+// turn the entry at entryPos into an empty slot, freeing the parent's blocks once it holds no entries
+// and compacting it once mostly empty, unless open where readers hold offsets into it
+void removeFromParentDir(struct inode *indexNode, struct directory_entry *entry, int entryPos)
+{
+  entry->inodeNum = 0;
+  entry->nameLen = 0;
+  indexNode->dirCount--;
+
+  if (0 == indexNode->dirCount)
+  {
+    freeINodeMem(indexNode);
+    return;
+  }
+
+  if (indexNode->dirTombstones < MAX_DIR_ENTRIES)
+  {
+    indexNode->dirTombstones++;
+  }
+  if (entryPos < indexNode->dirFreeHint)
+  {
+    indexNode->dirFreeHint = entryPos;
+  }
+
+  // a directory that can't be compacted now stays as it is, holes and all
+  if ((indexNode->dirTombstones >= DIR_COMPACT_TOMBSTONES) && (indexNode->dirTombstones > indexNode->dirCount) &&
+      (0 == indexNode->filesOpen))
+  {
+    compactDirectory(indexNode);
+  }
+}
+
+// call visit for every inode below rootNum and for rootNum itself, a directory after its entries
+// stops at the first visit returning non zero and returns that, iterative so deep trees cost no stack
+// visit may free what it's given, the entries of the directories being walked are left alone
+int walkTree(int rootNum, int (*visit)(int inodeNum))
+{
+  int depth = 0;
+  treeWalkStack[0].inodeNum = rootNum;
+  treeWalkStack[0].pos = 0;
+
+  while (depth >= 0)
+  {
+    struct tree_walk_frame *frame = &treeWalkStack[depth];
+    struct inode *indexNode = getINode(frame->inodeNum);
+    struct directory_entry *entry = NULL;
 
-    //same logic as above but for double indirect block pointers
-    if (0 == location[TOTAL_DOUBLE_INDIR_BLK_PTRS])
+    // next named entry of the directory
+    while ((dirINodeType == indexNode->type) && (frame->pos < indexNode->size))
     {
-      //dont proceed further if someone reading it
-      if (blockPointer->readOnly)
+      struct file_posn filePosition;
+      initFilePosn(&filePosition, indexNode, frame->pos, 1);
+      entry = (struct directory_entry *)getMemAddress(&filePosition);
+      if ((NULL == entry) || (0 == entry->recordLen))
       {
-        return -1;
+        entry = NULL;
+        break;
       }
-      else
+      frame->pos = frame->pos + entry->recordLen;
+      if (entry->nameLen > 0)
       {
-      
-        //if dont have enough space, fail
-        location[TOTAL_DOUBLE_INDIR_BLK_PTRS] = clearAllocateBlock();
-        if (location[TOTAL_DOUBLE_INDIR_BLK_PTRS] <= 0)
-        {
-          return -1;
-        }
+        break;
       }
+      entry = NULL;
     }
-    location = (int *)getBlockAddress(location[TOTAL_DOUBLE_INDIR_BLK_PTRS]);
-    if (0 == location[blockPointer->doubleIndirBlkPtrRow])
+
+    if (NULL == entry)
     {
-      if (blockPointer->readOnly)
-      {
-        return -1;
-      }
-      else
+      // every entry done, the directory itself goes last
+      int ret = visit(frame->inodeNum);
+      if (0 != ret)
       {
-        location[blockPointer->doubleIndirBlkPtrRow] = clearAllocateBlock();
-        if (location[blockPointer->doubleIndirBlkPtrRow] <= 0)
-        {
-          return -1;
-        }
+        return ret;
       }
+      depth--;
+      continue;
+    }
+
+    if ((dirINodeType == getINode(entry->inodeNum)->type) && (depth < MAX_INODES))
+    {
+      depth++;
+      treeWalkStack[depth].inodeNum = entry->inodeNum;
+      treeWalkStack[depth].pos = 0;
+      continue;
+    }
+
+    int ret = visit(entry->inodeNum);
+    if (0 != ret)
+    {
+      return ret;
     }
-    location = (int *)getBlockAddress(location[blockPointer->doubleIndirBlkPtrRow]);
   }
 
- // Check the type of block pointer
-if (directBlkPtr == blockPointer->blockPointerType)
+  return 0;
+}
+
+
+
+//use file position object to get the respective memory address corresponding to it
+char *getMemAddress(struct file_posn *filePosition)
 {
-  // If it's a direct block pointer, get the corresponding block index
-  blockPointer_index = blockPointer->directBlockPointer;
+  struct inode *indexNode = filePosition->blockPointer.indexNode;
+
+  //inline contents are addressed inside the inode itself
+  if (indexNode->flags & INODE_INLINE_DATA)
+  {
+    if (filePosition->filePosition >= INODE_INLINE_CAP)
+    {
+      return NULL;
+    }
+    return indexNode->inlineData + filePosition->filePosition;
+  }
+
+  //gets block pointer value from file position block pointer ref
+  int blockPtrValue = getBlkPtr(&filePosition->blockPointer);
+  if ((blockPtrValue <= 0) || (blockPtrValue >= TOTAL_BLK_COUNT))
+  {
+    return NULL;
+  }
+  return getBlockAddress(blockPtrValue) + filePosition->dataBlockOffset;
 }
-else if (singleIndirectBlkPtr == blockPointer->blockPointerType)
+
+//move inline contents out to a data block so the inode addresses blocks again
+int migrateInlineData(struct inode *indexNode)
 {
-  // If it's a single-indirect block pointer, get the corresponding block index
-  blockPointer_index = blockPointer->singleIndirectBlockPointer;
+  char data[INODE_INLINE_CAP];
+
+  memcpy(data, indexNode->inlineData, INODE_INLINE_CAP);
+  memset(indexNode->location, 0, sizeof(indexNode->location));
+  indexNode->flags &= ~INODE_INLINE_DATA;
+
+  if (indexNode->size > 0)
+  {
+    int blockPointer = clearAllocateBlock();
+    if (blockPointer <= 0)
+    {
+      //no memory, stay inline
+      memcpy(indexNode->inlineData, data, INODE_INLINE_CAP);
+      indexNode->flags |= INODE_INLINE_DATA;
+      return -1;
+    }
+    memcpy(getBlockAddress(blockPointer), data, indexNode->size);
+    indexNode->location[0] = blockPointer;
+  }
+
+  return 0;
 }
-else if (doubleIndirectBlkPtr == blockPointer->blockPointerType)
+// initialize file posn data struct
+void initFilePosn(struct file_posn *filePosition, struct inode *indexNode, int pos, int readOnly)
 {
-  // If it's a double-indirect block pointer, get the corresponding column index
-  blockPointer_index = blockPointer->doubleIndirBlkPtrColumn;
+  int block_number = pos / BLOCK_SIZE;
+  filePosition->filePosition = pos;
+
+  //use blick number and pointer information to init block pointer
+  initBlockPtr(&filePosition->blockPointer,
+    indexNode,
+    block_number,
+    readOnly);
+
+  //uses the position variable to offset the block data structure
+  filePosition->dataBlockOffset = pos % BLOCK_SIZE;
 }
 
-// Check if the block at the determined index is not allocated
-if (0 == location[blockPointer_index])
+//goes through and updates offset into file position and also into the block offset
+void filePosnAdjust(struct file_posn *filePosition, int offset)
 {
-  // If it's read-only, return -1 as it's not allowed to allocate for reading
-  if (blockPointer->readOnly)
+   // Updates file position and offset into data block
+  filePosition->filePosition = filePosition->filePosition + offset;
+  filePosition->dataBlockOffset = filePosition->dataBlockOffset + offset;
+
+  // Checks if the offset exceeds the block size, requiring an increase in block pointer
+  if (filePosition->dataBlockOffset >= BLOCK_SIZE)
   {
-    return -1;
+    blockPtrIncrease(&filePosition->blockPointer);
+    filePosition->dataBlockOffset = filePosition->dataBlockOffset - BLOCK_SIZE;
+  }
+}
+
+//primary function for initializing each of our block pointer data structures
+void initBlockPtr(struct blk_ptr*blockPointer, struct inode *indexNode, int block_number, int readOnly) {
+
+  //clear the block pointer structure
+  memset(blockPointer, 0, sizeof(struct blk_ptr));
+  blockPointer->readOnly = readOnly;
+  blockPointer->indexNode = indexNode;
+
+  //determine block pointer type based on the block numbers
+  if (block_number < TOTAL_DIRECT_BLK_PTRS)
+  {
+    blockPointer->blkPtrType = directBlkPtr;
+    blockPointer->dirBlkPtr = block_number;
+  }
+  else if (block_number < (TOTAL_DIRECT_BLK_PTRS + PTR_PER_BLOCK))
+  {
+    blockPointer->blkPtrType = singleIndirectBlkPtr;
+    blockPointer->singleIndirBlkPtr = block_number - TOTAL_DIRECT_BLK_PTRS;
   }
+  //need to use double indirect block pointers here
   else
   {
-    // Allocate one block for writing data
-    location[blockPointer_index] = allocateOneBlock();
+    blockPointer->blkPtrType = doubleIndirectBlkPtr;
+    blockPointer->doubleIndirBlkPtrRow = (block_number - (TOTAL_DIRECT_BLK_PTRS + PTR_PER_BLOCK)) / PTR_PER_BLOCK;
+    blockPointer->doubleIndirBlkPtrColumn = (block_number - (TOTAL_DIRECT_BLK_PTRS + PTR_PER_BLOCK)) % PTR_PER_BLOCK;
+  }
+}
+
+//helper method whenever a specific block pointer might need to be increased because of the offset
+void blockPtrIncrease(struct blk_ptr*blockPointer)
+{
+  
+  //check to determine whether to increase direct block pointer
+  if (directBlkPtr == blockPointer->blkPtrType)
+  {
+    blockPointer->dirBlkPtr++;
     
-    // If allocation fails, return -1
-    if (location[blockPointer_index] <= 0)
+    //if we are full with direct pointer, we need to start using single indirect
+    if (TOTAL_DIRECT_BLK_PTRS == blockPointer->dirBlkPtr)
     {
-      return -1;
+      blockPointer->blkPtrType = singleIndirectBlkPtr;
+      blockPointer->singleIndirBlkPtr = 0;
+      blockPointer->table = NULL;
     }
   }
-}
+  //check once again to determine whether or not to increase single indirect block pointer
+  else if (singleIndirectBlkPtr == blockPointer->blkPtrType)
+  {
+    blockPointer->singleIndirBlkPtr++;
 
-// Return the block pointer value of the corresponding block for reading or writing data
-return location[blockPointer_index];
+    //if single indirect full, need to move to double indirect
+    if (PTR_PER_BLOCK == blockPointer->singleIndirBlkPtr)
+    {
+      blockPointer->blkPtrType = doubleIndirectBlkPtr;
+      blockPointer->doubleIndirBlkPtrRow = 0;
+      blockPointer->doubleIndirBlkPtrColumn = 0;
+      blockPointer->table = NULL;
+    }
+  }
+  
+  else if (doubleIndirectBlkPtr == blockPointer->blkPtrType)
+  {
+    blockPointer->doubleIndirBlkPtrColumn++;
+  
+    if (PTR_PER_BLOCK == blockPointer->doubleIndirBlkPtrColumn)
+    {
+      blockPointer->doubleIndirBlkPtrRow++;
+      blockPointer->doubleIndirBlkPtrColumn = 0;
+      blockPointer->table = NULL;
+    }
+  }
 }
 
+//returns the indirect table referenced by slot, allocating a cleared one when writing
+//returns NULL if the table is missing while reading or there is no memory left
+int *getIndirectTable(int *slot, int readOnly)
+{
+  if (0 == *slot)
+  {
+    //dont proceed further if someone is reading it
+    if (readOnly)
+    {
+      return NULL;
+    }
 
+    //fail if no more memory as well
+    *slot = clearAllocateBlock();
+    if (*slot <= 0)
+    {
+      *slot = 0;
+      return NULL;
+    }
+  }
+  //a torn pointer seen by a lockless reader
+  else if ((*slot < 0) || (*slot >= TOTAL_BLK_COUNT))
+  {
+    return NULL;
+  }
+  //writers get their own copy of a table still shared with a clone
+  else if (!readOnly && isBlockShared(*slot))
+  {
+    if (0 != copyOnWrite(slot, 1))
+    {
+      return NULL;
+    }
+  }
+  return (int *)getBlockAddress(*slot);
+}
 
+//walks down to the table holding the entry for this block pointer and stores the entry index
+//direct pointers live in the inode itself, indirect ones in single or double indirect tables
+//the table is cached in the block pointer, consecutive blocks in one table skip the walk
+int *getBlkPtrTable(struct blk_ptr*blockPointer, int *index)
+{
+  int *location = blockPointer->indexNode->location;
 
+  if (directBlkPtr == blockPointer->blkPtrType)
+  {
+    *index = blockPointer->dirBlkPtr;
+    return location;
+  }
+
+  *index = (singleIndirectBlkPtr == blockPointer->blkPtrType) ? blockPointer->singleIndirBlkPtr : blockPointer->doubleIndirBlkPtrColumn;
+
+  //a table walked for reading may still be shared, writers walk again to copy it
+  if ((NULL != blockPointer->table) && (blockPointer->tableGeneration == blockMapGeneration) &&
+      (blockPointer->readOnly || blockPointer->tableWritable))
+  {
+    return blockPointer->table;
+  }
+
+  if (singleIndirectBlkPtr == blockPointer->blkPtrType)
+  {
+    location = getIndirectTable(&location[SINGLE_INDIR_LOC], blockPointer->readOnly);
+  }
+  //double indirect goes through the row table first, past the last row is beyond max file size
+  else if (blockPointer->doubleIndirBlkPtrRow >= PTR_PER_BLOCK)
+  {
+    location = NULL;
+  }
+  else
+  {
+    location = getIndirectTable(&location[DOUBLE_INDIR_LOC], blockPointer->readOnly);
+    if (NULL != location)
+    {
+      location = getIndirectTable(&location[blockPointer->doubleIndirBlkPtrRow], blockPointer->readOnly);
+    }
+  }
+
+  //copies made on the way have already bumped the generation
+  blockPointer->table = location;
+  blockPointer->tableWritable = !blockPointer->readOnly;
+  blockPointer->tableGeneration = blockMapGeneration;
+
+  return location;
+}
+
+//helps us with allocating the necessary required memory in blocks for our pointers to store data
+int getBlkPtr(struct blk_ptr*blockPointer)
+{
+  int blockPointer_index = 0;
+
+  int *location = getBlkPtrTable(blockPointer, &blockPointer_index);
+  if (NULL == location)
+  {
+    return -1;
+  }
+
+  // Check if the block at the determined index is not allocated
+  if (0 == location[blockPointer_index])
+  {
+    // If it's read-only, return -1 as it's not allowed to allocate for reading
+    if (blockPointer->readOnly)
+    {
+      return -1;
+    }
+
+    // Allocate one block for writing data, if allocation fails return -1
+    // cleared, a partial write to a hole must not leave stale bytes around it
+    location[blockPointer_index] = clearAllocateBlock();
+    if (location[blockPointer_index] <= 0)
+    {
+      location[blockPointer_index] = 0;
+      return -1;
+    }
+  }
+  // Writing to a block still shared with a clone, copy it first
+  else if (!blockPointer->readOnly && isBlockShared(location[blockPointer_index]))
+  {
+    if (0 != copyOnWrite(&location[blockPointer_index], 0))
+    {
+      return -1;
+    }
+  }
+
+  // Return the block pointer value of the corresponding block for reading or writing data
+  return location[blockPointer_index];
+}
+
+//return the slot holding the block pointer for blockPointer, tables are allocated in write mode
+int *getBlkPtrSlot(struct blk_ptr*blockPointer)
+{
+  int blockPointer_index = 0;
+
+  int *location = getBlkPtrTable(blockPointer, &blockPointer_index);
+  if (NULL == location)
+  {
+    return NULL;
+  }
+  return &location[blockPointer_index];
+}
+
+//check if the block at blockPointer is allocated, never allocates tables
+int isBlockMapped(struct blk_ptr*blockPointer)
+{
+  int readOnly = blockPointer->readOnly;
+
+  blockPointer->readOnly = 1;
+  int *slot = getBlkPtrSlot(blockPointer);
+  blockPointer->readOnly = readOnly;
+
+  return (NULL != slot) && (*slot > 0);
+}
+
+//release the block at blockPointer so it reads back as zeros, returns -1 if no memory
+//to copy a table still shared with a clone
+int punchBlock(struct blk_ptr*blockPointer)
+{
+  if (!isBlockMapped(blockPointer))
+  {
+    return 0;
+  }
+
+  int readOnly = blockPointer->readOnly;
+  blockPointer->readOnly = 0;
+  int *slot = getBlkPtrSlot(blockPointer);
+  blockPointer->readOnly = readOnly;
+  if (NULL == slot)
+  {
+    return -1;
+  }
+
+  freeBlock(*slot);
+  *slot = 0;
+  blockMapGeneration++;
+
+  return 0;
+}
+
+//rebuild the deferred queue from the inodes still being reclaimed in a ramdisk image that was just loaded
+void deferredFreeReset()
+{
+  deferredFreeHead = 0;
+  deferredFreeCount = 0;
+  for (int i = 1; i <= MAX_INODES; i++) {
+    if (reclaimINodeType == getINode(i)->type) {
+      deferredFree[deferredFreeCount++] = i;
+    }
+  }
+}
+
+//no file is open in a ramdisk image that was just loaded, whatever open counts it was saved with
+void clearOpenCounts()
+{
+  for (int i = 0; i <= MAX_INODES; i++) {
+    getINode(i)->filesOpen = 0;
+  }
+}
+
+//forget every block in the dedup index
+void dedupReset()
+{
+  memset(dedupTable, 0, sizeof(dedupTable));
+  memset(dedupIndexed, 0, sizeof(dedupIndexed));
+}
+
+//hash a full block a word at a time
+unsigned int dedupHash(const char *data)
+{
+  const unsigned int *words = (const unsigned int *)data;
+  unsigned int hash = 2166136261u;
+
+  for (int i = 0; i < (int)(BLOCK_SIZE / sizeof(unsigned int)); i++)
+  {
+    hash = (hash ^ words[i]) * 16777619u;
+  }
+  return hash ^ (hash >> 15);
+}
+
+//return an indexed block holding exactly data, 0 if there is none
+int dedupLookup(const char *data, unsigned int hash)
+{
+  int blockPointer = dedupTable[hash & (DEDUP_TABLE_SIZE - 1)];
+
+  if ((blockPointer <= 0) || !(dedupIndexed[blockPointer / 8] & (1 << (blockPointer % 8))))
+  {
+    return 0;
+  }
+  if (0 != memcmp(getBlockAddress(blockPointer), data, BLOCK_SIZE))
+  {
+    return 0;
+  }
+  return blockPointer;
+}
+
+//write one full block of data at blockPointer, sharing an identical block when the index has one
+//returns -1 if no memory
+int writeDedupBlock(struct blk_ptr*blockPointer, const char *data)
+{
+  unsigned int hash = dedupHash(data);
+  int match = dedupLookup(data, hash);
+
+  int *slot = getBlkPtrSlot(blockPointer);
+  if (NULL == slot)
+  {
+    return -1;
+  }
+
+  if (match > 0)
+  {
+    if (match == *slot)
+    {
+      return 0; // already holds these contents
+    }
+    if (0 == shareBlock(match))
+    {
+      if (*slot > 0)
+      {
+        freeBlock(*slot);
+      }
+      *slot = match;
+      blockMapGeneration++;
+      return 0;
+    }
+    // share count saturated, store a copy of its own
+  }
+
+  int block = getBlkPtr(blockPointer);
+  if (block <= 0)
+  {
+    return -1;
+  }
+  memcpy(getBlockAddress(block), data, BLOCK_SIZE);
+
+  // newest copy wins the bucket
+  dedupTable[hash & (DEDUP_TABLE_SIZE - 1)] = block;
+  dedupIndexed[block / 8] |= (1 << (block % 8));
+
+  return 0;
+}
+
+//write one full block of data at blockPointer, returns -1 if no memory
+//an all zero block is left as a hole, a shared block is replaced rather than copied first
+int writeFullBlock(struct blk_ptr*blockPointer, const char *data, int dedup)
+{
+  if (NULL == memchr_inv(data, 0, BLOCK_SIZE))
+  {
+    return punchBlock(blockPointer);
+  }
+  if (dedup)
+  {
+    return writeDedupBlock(blockPointer, data);
+  }
+
+  int *slot = getBlkPtrSlot(blockPointer);
+  if (NULL == slot)
+  {
+    return -1;
+  }
+  if ((0 == *slot) || isBlockShared(*slot))
+  {
+    int block = allocateOneBlock();
+    if (block <= 0)
+    {
+      return -1;
+    }
+    if (*slot > 0)
+    {
+      freeBlock(*slot);
+      blockMapGeneration++;
+    }
+    *slot = block;
+  }
+  memcpy(getBlockAddress(*slot), data, BLOCK_SIZE);
+
+  return 0;
+}
+
+//slots of the block pointers covering chunk of indexNode, NULL if a table is missing in read mode
+int *getChunkSlots(struct inode *indexNode, int chunk, int readOnly)
+{
+  struct blk_ptr blockPointer;
+
+  initBlockPtr(&blockPointer, indexNode, chunk * COMPRESS_CHUNK_BLOCKS, readOnly);
+  return getBlkPtrSlot(&blockPointer);
+}
+
+//cached decompressed copy of chunk, NULL unless the block map is unchanged since it was filled
+struct chunk_cache_entry *findCachedChunk(struct inode *indexNode, int chunk)
+{
+  for (int i = 0; i < CHUNK_CACHE_ENTRIES; i++)
+  {
+    struct chunk_cache_entry *entry = &chunkCache[i];
+    if ((entry->indexNode == indexNode) && (entry->chunk == chunk) && (entry->generation == blockMapGeneration))
+    {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+//remember the decompressed contents of chunk
+void cacheChunk(struct inode *indexNode, int chunk, const char *data)
+{
+  struct chunk_cache_entry *entry = findCachedChunk(indexNode, chunk);
+  if (NULL == entry)
+  {
+    entry = &chunkCache[chunkCacheNext];
+    chunkCacheNext = (chunkCacheNext + 1) % CHUNK_CACHE_ENTRIES;
+  }
+  entry->indexNode = indexNode;
+  entry->chunk = chunk;
+  entry->generation = blockMapGeneration;
+  memcpy(entry->data, data, COMPRESS_CHUNK_SIZE);
+}
+
+//fill data with chunk of indexNode, holes and bytes past what was stored read as zeros
+//returns -1 if the compressed data is corrupt
+int loadChunk(struct inode *indexNode, int chunk, char *data)
+{
+  struct chunk_cache_entry *entry = findCachedChunk(indexNode, chunk);
+  if (NULL != entry)
+  {
+    memcpy(data, entry->data, COMPRESS_CHUNK_SIZE);
+    return 0;
+  }
+
+  memset(data, 0, COMPRESS_CHUNK_SIZE);
+  int *slots = getChunkSlots(indexNode, chunk, 1);
+  if (NULL == slots)
+  {
+    return 0;
+  }
+
+  //stored raw, a block per slot
+  int storedLen = -slots[COMPRESS_CHUNK_BLOCKS - 1];
+  if (storedLen <= 0)
+  {
+    for (int i = 0; i < COMPRESS_CHUNK_BLOCKS; i++)
+    {
+      if (slots[i] > 0)
+      {
+        memcpy(data + i * BLOCK_SIZE, getBlockAddress(slots[i]), BLOCK_SIZE);
+      }
+    }
+    return 0;
+  }
+
+  for (int i = 0; i * BLOCK_SIZE < storedLen; i++)
+  {
+    memcpy(compressBuffer + i * BLOCK_SIZE, getBlockAddress(slots[i]), BLOCK_SIZE);
+  }
+  if (LZ4_decompress_safe(compressBuffer, data, storedLen, COMPRESS_CHUNK_SIZE) < 0)
+  {
+    return -1;
+  }
+  cacheChunk(indexNode, chunk, data);
+
+  return 0;
+}
+
+//store the first rawLen bytes of data as chunk of indexNode, compressed if that saves a block
+//the chunk always lands in fresh blocks before the old ones are released, so blocks shared with
+//a clone are never written in place and a failure leaves the old contents, returns -1 if no memory
+int storeChunk(struct inode *indexNode, int chunk, const char *data, int rawLen, int compress)
+{
+  int blocks[COMPRESS_CHUNK_BLOCKS];
+  const char *src = data;
+  int len = rawLen;
+  int storedLen = 0;
+  int count = (rawLen + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+  //all zero chunks are left as holes
+  if (NULL == memchr_inv(data, 0, rawLen))
+  {
+    count = 0;
+  }
+  else if (compress)
+  {
+    storedLen = LZ4_compress_default(data, compressBuffer, rawLen,
+      (COMPRESS_CHUNK_BLOCKS - 1) * BLOCK_SIZE, compressWorkspace);
+    if ((storedLen > 0) && (((storedLen + BLOCK_SIZE - 1) / BLOCK_SIZE) < count))
+    {
+      src = compressBuffer;
+      len = storedLen;
+      count = (storedLen + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+    else
+    {
+      storedLen = 0;
+    }
+  }
+
+  int *slots = getChunkSlots(indexNode, chunk, 0);
+  if (NULL == slots)
+  {
+    return -1;
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    blocks[i] = allocateOneBlock();
+    if (blocks[i] <= 0)
+    {
+      while (--i >= 0)
+      {
+        freeBlock(blocks[i]);
+      }
+      return -1;
+    }
+
+    int blockLen = (len - i * BLOCK_SIZE < BLOCK_SIZE) ? (len - i * BLOCK_SIZE) : BLOCK_SIZE;
+    char *blockAddress = getBlockAddress(blocks[i]);
+    memcpy(blockAddress, src + i * BLOCK_SIZE, blockLen);
+    memset(blockAddress + blockLen, 0, BLOCK_SIZE - blockLen);
+  }
+
+  for (int i = 0; i < COMPRESS_CHUNK_BLOCKS; i++)
+  {
+    if (slots[i] > 0)
+    {
+      freeBlock(slots[i]);
+    }
+    slots[i] = (i < count) ? blocks[i] : 0;
+  }
+  if (storedLen > 0)
+  {
+    slots[COMPRESS_CHUNK_BLOCKS - 1] = -storedLen;
+  }
+  blockMapGeneration++;
+
+  if (storedLen > 0)
+  {
+    cacheChunk(indexNode, chunk, data);
+  }
+
+  return 0;
+}
+
+//rewrite every chunk of indexNode compressed or raw, returns -1 if no memory
+//chunks describe their own layout, so whichever chunk a failure stops at the file still reads in compressed mode
+int recompressINode(struct inode *indexNode, int compress)
+{
+  for (int chunk = 0; chunk * COMPRESS_CHUNK_SIZE < indexNode->size; chunk++)
+  {
+    int rawLen = indexNode->size - chunk * COMPRESS_CHUNK_SIZE;
+    if (rawLen > COMPRESS_CHUNK_SIZE)
+    {
+      rawLen = COMPRESS_CHUNK_SIZE;
+    }
+    if ((0 != loadChunk(indexNode, chunk, chunkData)) ||
+        (0 != storeChunk(indexNode, chunk, chunkData, rawLen, compress)))
+    {
+      return -1;
+    }
+  }
+  //raw files are written in place, nothing cached for them may outlive the switch
+  blockMapGeneration++;
+
+  return 0;
+}
+
+//resolves up to max consecutive block pointers starting at blockPointer with a single table walk
+//stops at the end of the table holding the first entry or at the first unmapped block
+int getBlkPtrRun(struct blk_ptr*blockPointer, int *blocks, int max)
+{
+  int index = 0;
+  int count = 0;
+
+  int *location = getBlkPtrTable(blockPointer, &index);
+  if (NULL == location)
+  {
+    return 0;
+  }
+
+  int tableLen = (directBlkPtr == blockPointer->blkPtrType) ? TOTAL_DIRECT_BLK_PTRS : PTR_PER_BLOCK;
+  while ((count < max) && ((index + count) < tableLen) && (location[index + count] > 0))
+  {
+    blocks[count] = location[index + count];
+    count++;
+  }
+
+  return count;
+}
+
+//refill the read-ahead window of an open file with the block numbers from blockNumber on
+//and hint the cpu to start pulling the data blocks in
+void fillReadAhead(struct open_file *openFile, int blockNumber)
+{
+  struct blk_ptr blockPointer;
+  struct inode *indexNode = openFile->indexNode;
+  int lastBlock = (indexNode->size - 1) / BLOCK_SIZE;
+  int count = 0;
+
+  while ((count < READ_AHEAD_BLOCKS) && ((blockNumber + count) <= lastBlock))
+  {
+    int max = READ_AHEAD_BLOCKS - count;
+    if (max > (lastBlock - (blockNumber + count) + 1))
+    {
+      max = lastBlock - (blockNumber + count) + 1;
+    }
+
+    initBlockPtr(&blockPointer, indexNode, blockNumber + count, 1);
+    int resolved = getBlkPtrRun(&blockPointer, openFile->raBlocks + count, max);
+    if (resolved <= 0)
+    {
+      break;
+    }
+    count = count + resolved;
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    prefetch(getBlockAddress(openFile->raBlocks[i]));
+  }
+
+  openFile->raFirstBlock = blockNumber;
+  openFile->raCount = count;
+  openFile->raGeneration = blockMapGeneration;
+}
+
+//same as getMemAddress for the open file position, but served from the read-ahead window
+char *getReadAheadAddress(struct open_file *openFile)
+{
+  struct file_posn *filePosition = &openFile->filePosition;
+  int blockNumber = filePosition->filePosition / BLOCK_SIZE;
+  int index = blockNumber - openFile->raFirstBlock;
+
+  if ((openFile->raGeneration != blockMapGeneration) || (index < 0) || (index >= openFile->raCount))
+  {
+    fillReadAhead(openFile, blockNumber);
+    index = 0;
+  }
+
+  // unmapped block, let the regular lookup decide
+  if (0 == openFile->raCount)
+  {
+    return getMemAddress(filePosition);
+  }
+
+  return getBlockAddress(openFile->raBlocks[index]) + filePosition->dataBlockOffset;
+}
+
+//address of offset pos of the directory open as openFile, the block under the cursor is resolved
+//once and reused until the cursor leaves it or a block is released, returns NULL past the directory
+char *getDirCursorAddress(struct open_file *openFile, int pos)
+{
+  struct inode *indexNode = openFile->indexNode;
+
+  if (indexNode->flags & INODE_INLINE_DATA)
+  {
+    return (pos < INODE_INLINE_CAP) ? indexNode->inlineData + pos : NULL;
+  }
+
+  int blockNumber = pos / BLOCK_SIZE;
+  if ((openFile->dirGeneration != blockMapGeneration) || (openFile->dirBlockNumber != blockNumber) ||
+      (openFile->dirBlock <= 0))
+  {
+    struct blk_ptr blockPointer;
+    initBlockPtr(&blockPointer, indexNode, blockNumber, 1);
+    int blockPtrValue = getBlkPtr(&blockPointer);
+    openFile->dirBlock = ((blockPtrValue > 0) && (blockPtrValue < TOTAL_BLK_COUNT)) ? blockPtrValue : 0;
+    openFile->dirBlockNumber = blockNumber;
+    openFile->dirGeneration = blockMapGeneration;
+    if (0 == openFile->dirBlock)
+    {
+      return NULL;
+    }
+  }
+
+  return getBlockAddress(openFile->dirBlock) + (pos % BLOCK_SIZE);
+}
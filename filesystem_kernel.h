@@ -2,40 +2,107 @@
 #define _KERNEL_STRUCTS_H
 
 
+// inode flags
+#define INODE_INLINE_DATA 0x1 // contents live in inlineData, no blocks allocated
+#define INODE_DEDUP RD_FLAG_DEDUP // full block writes go through the dedup index
+#define INODE_COMPRESS RD_FLAG_COMPRESS // data is read and written a compressed chunk at a time
+
+// flags rd_setflags may change, new entries inherit them from their directory
+#define INODE_USER_FLAGS (INODE_DEDUP | INODE_COMPRESS)
+
+// file blocks compressed as one unit, chunks line up with the block pointer tables
+// a compressed chunk keeps its blocks in the leading slots and minus its stored length in the last one
+#define COMPRESS_CHUNK_BLOCKS 4
+#define COMPRESS_CHUNK_SIZE (COMPRESS_CHUNK_BLOCKS * RD_BLOCK_SIZE)
+
+// decompressed chunks kept for readers
+#define CHUNK_CACHE_ENTRIES 8
+
+// an inode fills exactly one cache line
+#define INODE_SIZE 64
+
+// bytes of contents an inode can hold inline, whatever the hot fields leave of the line
+#define INODE_INLINE_CAP 40
+
+//signify type of inode, unused inodes are zeroed
+enum inode_type {
+  unusedINodeType = 0,
+  regINodeType = 1,
+  dirINodeType = 2,
+  reclaimINodeType = 3 // unlinked, stays reserved until reclaimDeferredBlocks has freed its blocks
+};
+
+// most names a single inode can have
+#define MAX_LINK_COUNT 0xFFFF
+
+// most entries and empty slots a directory keeps count of
+#define MAX_DIR_ENTRIES 0xFFFF
+
+// a directory is compacted once it has at least this many empty slots and more of them than entries
+#define DIR_COMPACT_TOMBSTONES 16
+
 // INDEX NODE STRUCT
+// hot fields checked on every lookup, read and write come first, then the block pointers
 struct inode {
-  char type[4];
   int size;
-  int location[10];
-  int dirCount;
+  unsigned char type;
+  unsigned char flags;
+  unsigned short linkCount; // directory entries naming this inode
   int filesOpen;
-  char padding[8];
-} 
+  unsigned short dirCount;
+  unsigned short dirTombstones; // empty directory slots, removed entries and block tail padding
+  unsigned int generation; // moves on every time the inode is reset, never cleared
+  int dirFreeHint; // no empty directory slot comes before this offset
+  union {
+    int location[10];
+    char inlineData[INODE_INLINE_CAP];
+  };
+} __attribute__((aligned(INODE_SIZE)));
+
+// marks a formatted ramdisk, lets an image file be told apart from an empty one
+#define RD_SUPER_MAGIC 0x52445342
+
+// on-ramdisk layout, bumped with every change to the superblock, inode, directory entry, bitmap or
+// share count formats, images of any other layout are refused rather than misread
+// 1 share counts after the bitmap, 2 link counts, 3 inode generations,
+// 4 directory tombstones and free slot hints, the first one recorded in the superblock,
+// 5 unlinked inodes kept as reclaimINodeType while their blocks are freed
+#define RD_LAYOUT_VERSION 5
 
 // SUPERBLOCK STRUCT 
+// the root inode lands on its own cache line through the inode alignment
 struct super_block {
   int freeBlocks;
   int freeINodes;
+  int magic;
+  int layoutVersion;
   struct inode first;
-} 
+};
 
 
 // DIRECTORY ENTRY STRUCT
+// variable length, nameLen bytes of name (no NUL) follow the header and recordLen
+// spans up to the next entry, entries never straddle a block, nameLen 0 is a free slot
 struct directory_entry {
-  char filename[14];
   short inodeNum;
-}
+  unsigned char recordLen;
+  unsigned char nameLen;
+  char filename[];
+};
+
+// bytes taken by an entry for a name of nameLen, kept 4 byte aligned
+#define DIR_ENTRY_LEN(nameLen) ((sizeof(struct directory_entry) + (nameLen) + 3) & ~3)
 
 //signify type of block ptr
 enum blk_ptr_type {
   directBlkPtr = 1,
   singleIndirectBlkPtr = 2,
   doubleIndirectBlkPtr = 3
-} 
+};
 
 
 // BLOCK PTR STRUCT
-blk_ptr {
+struct blk_ptr {
   int readOnly;
   enum blk_ptr_type blkPtrType;
   int dirBlkPtr;
@@ -44,13 +111,162 @@ blk_ptr {
   int doubleIndirBlkPtrColumn;
   struct inode *indexNode;
 
-}
+  // table holding the entry, kept across getBlkPtr calls while tableGeneration matches blockMapGeneration
+  // so the next block in the same table is found without walking location[] and the indirect tables again
+  int *table;
+  int tableWritable; // walked in write mode, shared tables on the way were already copied
+  unsigned int tableGeneration;
+};
 
 // FILE POSN STRUCT
 struct file_posn {
   int filePosition;
   int dataBlockOffset;
   struct blk_ptr blockPointer;
-}
+};
+
+// CHUNK CACHE ENTRY STRUCT
+// valid while generation matches blockMapGeneration, storing a chunk refreshes its entry
+struct chunk_cache_entry {
+  struct inode *indexNode;
+  int chunk;
+  unsigned int generation;
+  char data[COMPRESS_CHUNK_SIZE];
+};
+
+// block numbers resolved ahead of a sequential reader
+#define READ_AHEAD_BLOCKS 32
+
+// OPEN FILE STRUCT
+// one per rd_open, keeps the current position between reads and writes
+struct open_file {
+  int inUse;
+  int nextFree;
+  int inodeNum;
+  struct inode *indexNode;
+  struct file_posn filePosition;
+
+  // sequential access detection
+  int nextSeqPosition;
+  int seqReads;
+
+  // read-ahead window, raBlocks[i] holds the block of file block raFirstBlock + i
+  int raFirstBlock;
+  int raCount;
+  unsigned int raGeneration;
+  int raBlocks[READ_AHEAD_BLOCKS];
+
+  // directory cursor, the next readdir resumes at dirPosition
+  // dirBlock holds the block of file block dirBlockNumber while dirGeneration matches
+  int dirPosition;
+  int dirBlockNumber;
+  int dirBlock;
+  unsigned int dirGeneration;
+};
+
+// TREE WALK FRAME STRUCT
+// a directory being walked by walkTree and the offset of its next entry
+struct tree_walk_frame {
+  int inodeNum;
+  int pos;
+};
+
+
+// ENGINE FUNCTIONS
+// defined in filesystem_kernel.c in this order, declared up front so any of them can call any other
+int ramdiskInitOperations(void);
+#ifdef RD_USERSPACE
+int ramdiskInitFromFile(const char *path);
+int ramdiskSync(void);
+#endif
+void formatRamdisk(void);
+int initOpenFileTable(void);
+int allocateBlockAt(int blockPointer);
+int initCompression(void);
+int allocateOneBlock(void);
+void uninitialize(void);
+int allocateOpenFile(int inodeNum);
+struct open_file *getOpenFile(int handle);
+void freeOpenFile(int handle);
+int isValidINodeNum(int inodeNum);
+struct inode *getINode(int inodeNum);
+unsigned char *getBitmap(void);
+unsigned short *getBlockShares(void);
+int isBlockShared(int blockPointer);
+int shareBlock(int blockPointer);
+char *getBlockAddress(int blockPointer);
+int isBlockUsed(int blockPointer);
+int getPathINodeNum(const char *pathname);
+int countTableBlocks(int blockPointer, int depth);
+int countExtentBlock(int block, int *prev);
+int countTableExtents(int blockPointer, int depth, int *prev);
+int countExtents(struct inode *indexNode);
+void fillStat(int inodeNum, struct rd_stat *stat);
+int nextUsedExtent(int from, int *count);
+int nextFreeExtent(int from, int *count);
+void fillFragReport(struct rd_frag_report *report);
+struct inode* getDirIndexNodeAt(struct inode *start, const char *pathname);
+struct inode* getDirIndexNode(const char *pathname);
+int pathPassesThrough(const char *pathname, struct inode *indexNode);
+static const char* getNextDir(const char* path);
+struct directory_entry *findDirEntry(struct inode *indexNode, const char *fnameStart, const char *fnameEnd, int *entryPos);
+struct directory_entry *getDirectory(struct inode *indexNode, const char *fnameStart, const char *fnameEnd);
+int batchNameBucket(const char *name, int nameLen);
+int findBatchName(const char *name, int nameLen, int count);
+int loadBatchNames(const char *names, int namesLen, int count);
+int indexBatchNames(int count);
+int firstBatchNameInDir(struct inode *indexNode, int count);
+const char* UsingPathGetFileName(const char* pathname);
+void freeIndirectTable(int blockPointer, int depth);
+void freeINodeMem(struct inode *indexNode);
+void releaseINodeDeferred(struct inode *indexNode);
+int reclaimLocation(int *location);
+int reclaimDeferredBlocks(int steps);
+void reclaimAllDeferredBlocks(void);
+int getAvailableNode(void);
+struct directory_entry *findEmptyDirEntry(struct inode *indexNode, int recordLen);
+int clearAllocateBlock(void);
+void freeBlock(int blockPointer);
+void freeBlockRun(int blockPointer, int count);
+struct directory_entry *appendDirEntry(struct inode *indexNode, int recordLen);
+int addToParentDir(struct inode *indexNode, const char *filename, int inodeNum);
+int addDirEntry(struct inode *indexNode, const char *filename, int inodeNum, int reuseSlot);
+void resetINode(struct inode *indexNode);
+void releaseINode(struct inode *indexNode);
+int shareINodeBlocks(struct inode *dst, struct inode *src);
+int copyOnWrite(int *slot, int isTable);
+int releaseBlocksFrom(struct inode *indexNode, int firstBlock, int blockCount);
+int compactDirectory(struct inode *indexNode);
+void removeFromParentDir(struct inode *indexNode, struct directory_entry *entry, int entryPos);
+int walkTree(int rootNum, int (*visit)(int inodeNum));
+char *getMemAddress(struct file_posn *filePosition);
+int migrateInlineData(struct inode *indexNode);
+void initFilePosn(struct file_posn *filePosition, struct inode *indexNode, int pos, int readOnly);
+void filePosnAdjust(struct file_posn *filePosition, int offset);
+void initBlockPtr(struct blk_ptr *blockPointer, struct inode *indexNode, int block_number, int readOnly);
+void blockPtrIncrease(struct blk_ptr *blockPointer);
+int *getIndirectTable(int *slot, int readOnly);
+int *getBlkPtrTable(struct blk_ptr *blockPointer, int *index);
+int getBlkPtr(struct blk_ptr *blockPointer);
+int *getBlkPtrSlot(struct blk_ptr *blockPointer);
+int isBlockMapped(struct blk_ptr *blockPointer);
+int punchBlock(struct blk_ptr *blockPointer);
+void deferredFreeReset(void);
+void clearOpenCounts(void);
+void dedupReset(void);
+unsigned int dedupHash(const char *data);
+int dedupLookup(const char *data, unsigned int hash);
+int writeDedupBlock(struct blk_ptr *blockPointer, const char *data);
+int writeFullBlock(struct blk_ptr *blockPointer, const char *data, int dedup);
+int *getChunkSlots(struct inode *indexNode, int chunk, int readOnly);
+struct chunk_cache_entry *findCachedChunk(struct inode *indexNode, int chunk);
+void cacheChunk(struct inode *indexNode, int chunk, const char *data);
+int loadChunk(struct inode *indexNode, int chunk, char *data);
+int storeChunk(struct inode *indexNode, int chunk, const char *data, int rawLen, int compress);
+int recompressINode(struct inode *indexNode, int compress);
+int getBlkPtrRun(struct blk_ptr *blockPointer, int *blocks, int max);
+void fillReadAhead(struct open_file *openFile, int blockNumber);
+char *getReadAheadAddress(struct open_file *openFile);
+char *getDirCursorAddress(struct open_file *openFile, int pos);
 
-#endif
\ No newline at end of file
+#endif
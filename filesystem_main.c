@@ -1,16 +1,32 @@
+#ifdef RD_USERSPACE
+// the ioctl dispatch alone, for drivers calling rd_ioctl in process
+#include "filesystem_userspace.h"
+#else
 #include <linux/module.h>
 #include <linux/init.h>
 #include <linux/errno.h> /* error codes */
 #include <linux/proc_fs.h>
-#include <asm/uaccess.h>
+#include <linux/uaccess.h>
 #include <linux/tty.h>
 #include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/seqlock.h>
+#include <linux/workqueue.h>
 
 MODULE_LICENSE("GPL");
+#endif
+
+// written against the 5.10 LTS kernel, the first long term release with every interface the module
+// uses: proc_ops for /proc/ramdisk (5.6), the lz4 calls taking a caller's workspace behind
+// compressed files (4.11) and blk-mq for /dev/rdblk
 
 
 #include "filesystem_structs.h"
 #include "filesystem_functions_kernel.h"
+#ifndef RD_USERSPACE
+#include "filesystem_blkdev_kernel.h"
+#endif
 
 
 #ifndef _RD_FUNCTIONS
@@ -25,29 +41,83 @@ MODULE_LICENSE("GPL");
 #define RD_LSEEK _IOWR(0, 17, struct lseekParam)
 #define RD_UNLINK _IOWR(0, 12, struct pathParam)
 #define RD_READDIR _IOWR(0, 19, struct readdirParam)
+#define RD_SNAPSHOT _IOWR(0, 20, struct imageParam)
+#define RD_RESTORE _IOWR(0, 21, struct imageParam)
+#define RD_CLONE _IOWR(0, 22, struct pathPairParam)
+#define RD_SETFLAGS _IOWR(0, 23, struct flagsParam)
+#define RD_ZERO_RANGE _IOWR(0, 24, struct zeroRangeParam)
+#define RD_RENAME _IOWR(0, 25, struct pathPairParam)
+#define RD_LINK _IOWR(0, 26, struct pathPairParam)
+#define RD_STAT _IOWR(0, 27, struct statParam)
+#define RD_READDIRPLUS _IOWR(0, 28, struct readdirplusParam)
+#define RD_CREATAT _IOWR(0, 29, struct atParam)
+#define RD_MKDIRAT _IOWR(0, 30, struct atParam)
+#define RD_OPENAT _IOWR(0, 31, struct atParam)
+#define RD_UNLINKAT _IOWR(0, 32, struct atParam)
+#define RD_OPEN_BY_HANDLE _IOWR(0, 33, struct openHandleParam)
+#define RD_RMTREE _IOWR(0, 34, struct pathParam)
+#define RD_CREATE_MANY _IOWR(0, 35, struct createManyParam)
+#define RD_FRAG_REPORT _IOWR(0, 36, struct fragReportParam)
+#define RD_DEFRAG _IOWR(0, 37, struct pathParam)
 
 #endif
 
 
-static struct file_operations pseudo_dev_proc_operations;
+static long rd_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+static int rd_ioctl_locked(struct file *file, unsigned int cmd, unsigned long arg);
+
+#ifndef RD_USERSPACE
 static struct proc_dir_entry *proc_entry;
-static int rd_ioctl(struct inode *inode, struct file *file, unsigned int cmd, unsigned long arg);
-void ramdiskInitOperations(void);
 
+static const struct proc_ops pseudo_dev_proc_operations = {
+  .proc_ioctl = rd_ioctl,
+};
+#endif
+
+// held across each ioctl so multi step updates, like a rename, are never seen half done
+static DEFINE_MUTEX(rdLock);
+
+// bumped by rdLock holders around every change to directories or inodes, the fields RD_STAT
+// reports included, lets path lookups run without rdLock and retry when a change overlapped them
+// write sections cover only the engine calls, never a user copy
+static seqcount_mutex_t rdNamespaceSeq;
+
+// lockless lookup attempts before a lookup waits for rdLock instead
+#define LOCKLESS_LOOKUP_TRIES 4
+
+// reclaim steps the background worker runs per hold of rdLock, each frees at most one table of blocks
+#define RECLAIM_STEPS_PER_LOCK 4
+
+// frees the blocks of large unlinked files outside of the unlink call
+static void rdReclaimWorker(struct work_struct *work);
+static DECLARE_WORK(rdReclaimWork, rdReclaimWorker);
+int ramdiskInitOperations(void);
+
+#ifndef RD_USERSPACE
 static int __init initialization_routine(void) {
-  pseudo_dev_proc_operations.ioctl = rd_ioctl;
+  // everything an ioctl reaches is set up before /proc/ramdisk makes ioctls possible
+  seqcount_mutex_init(&rdNamespaceSeq, &rdLock);
+  if (0 != ramdiskInitOperations()) {
+    printk("<1> Error allocating the ramdisk.\n");
+    uninitialize();
+    return -ENOMEM;
+  }
+
+  // the file API works without the block device
+  if (0 != rdBlkdevInit()) {
+    printk("<1> Error registering the ramdisk block device.\n");
+  }
 
   /* Start create proc entry */
-  proc_entry = create_proc_entry("ramdisk", 0444, NULL);
+  proc_entry = proc_create("ramdisk", 0444, NULL, &pseudo_dev_proc_operations);
   if(!proc_entry)
   {
     printk("<1> Error creating /proc entry.\n");
-    return 1;
+    rdBlkdevExit();
+    uninitialize();
+    return -ENOMEM;
   }
 
-  proc_entry->proc_fops = &pseudo_dev_proc_operations;
-  ramdiskInitOperations();
-
   return 0;
 }
 
@@ -63,89 +133,342 @@ void my_printk(char *string)
     (*my_tty->driver->ops->write)(my_tty, "\015\012", 2);
   }
 } 
+#endif
 
 void uninitialize(void);
 
+// copy len bytes in from user space with a NUL after them, NULL if longer than maxLen or unreadable,
+// caller kfrees it
+static char *getUserString(const char *userString, int len, int maxLen)
+{
+  if ((len < 0) || (len > maxLen)) {
+    return NULL;
+  }
+
+  char *string = (char *)kmalloc(len + 1, GFP_KERNEL);
+  if (NULL == string) {
+    return NULL;
+  }
+  if (0 != copy_from_user(string, userString, len)) {
+    kfree(string);
+    return NULL;
+  }
+  string[len] = '\0';
+
+  return string;
+}
+
+// copy a path argument in from user space, NULL if it is too long or unreadable, caller kfrees it
+static char *getUserPath(const char *userPath, int pathLen)
+{
+  return getUserString(userPath, pathLen, RD_MAX_PATH_LEN);
+}
+
+#ifndef RD_USERSPACE
 // cleanup from primer
 static void __exit cleanup_routine(void) {
 
-  uninitialize();
+  // proc_ops don't pin the module, removing the entry waits out the ioctls already running,
+  // so nothing can queue the worker again once it is cancelled
   remove_proc_entry("ramdisk", NULL);
+  rdBlkdevExit();
+  cancel_work_sync(&rdReclaimWork);
+  uninitialize();
 
   return;
 }
+#endif
+
+
+// resolve path without rdLock, a lookup overlapping a namespace change is thrown away and retried
+// ramdisk blocks stay mapped once freed, so a torn read only needs the lookup's bounds checks
+static int lookupLockless(char *path, struct rd_file_handle *fileHandle, struct rd_stat *stat)
+{
+  for (int tries = 0; tries < LOCKLESS_LOOKUP_TRIES; tries++) {
+    unsigned int seq = raw_seqcount_begin(&rdNamespaceSeq);
+    int ret = rd_lookup_kernel(path, fileHandle, stat);
+    if (!read_seqcount_retry(&rdNamespaceSeq, seq)) {
+      return ret;
+    }
+    cpu_relax();
+  }
+
+  // writers kept getting in the way, queue behind them
+  mutex_lock(&rdLock);
+  int ret = rd_lookup_kernel(path, fileHandle, stat);
+  mutex_unlock(&rdLock);
+
+  return ret;
+}
+
+// RD_STAT, only reads so it never takes rdLock
+static int rd_ioctl_stat(unsigned long arg)
+{
+  struct statParam statParams;
+  struct rd_file_handle fileHandle;
+
+  copy_from_user(&statParams, (struct statParam *)arg, sizeof(struct statParam));
+  char *path = getUserPath(statParams.path, statParams.pathLen);
+  int retStat = -1;
+  if (NULL != path) {
+    retStat = lookupLockless(path, &fileHandle, &statParams.stat);
+  }
+  statParams.returnVal = retStat;
+  copy_to_user((struct statParam *)arg, &statParams, sizeof(struct statParam));
+  kfree(path);
+
+  return 0;
+}
+
+// RD_OPEN, the path is resolved without rdLock, which is only taken to open the file found
+// the open fails if the file was unlinked in between, as if it came after the unlink
+static int rd_ioctl_open(unsigned long arg)
+{
+  struct openParam openParams;
+  struct rd_file_handle fileHandle;
+
+  copy_from_user(&openParams, (struct openParam *)arg, sizeof(struct openParam));
+  char *path = getUserPath(openParams.path, openParams.pathLen);
+  int retOpen = -1;
+  if ((NULL != path) && (0 == lookupLockless(path, &fileHandle, NULL))) {
+    mutex_lock(&rdLock);
+    write_seqcount_begin(&rdNamespaceSeq);
+    retOpen = rd_open_by_handle_kernel(&fileHandle, &openParams.handle);
+    write_seqcount_end(&rdNamespaceSeq);
+    mutex_unlock(&rdLock);
+  }
+  openParams.returnVal = retOpen;
+  copy_to_user((struct openParam *)arg, &openParams, sizeof(struct openParam));
+  kfree(path);
+
+  return 0;
+}
+
+// path lookups run without rdLock, every other ioctl one at a time under it
+static long rd_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+  if (RD_STAT == cmd) {
+    return rd_ioctl_stat(arg);
+  }
+  if (RD_OPEN == cmd) {
+    return rd_ioctl_open(arg);
+  }
+
+  mutex_lock(&rdLock);
+  int ret = rd_ioctl_locked(file, cmd, arg);
+  if (deferredFreeCount > 0) {
+    schedule_work(&rdReclaimWork);
+  }
+  mutex_unlock(&rdLock);
+
+  return ret;
+}
+
+// release deferred blocks a few steps at a time, dropping rdLock in between so ioctls
+// never wait on more than RECLAIM_STEPS_PER_LOCK steps
+static void rdReclaimWorker(struct work_struct *work)
+{
+  int more = 1;
+  while (more) {
+    mutex_lock(&rdLock);
+    write_seqcount_begin(&rdNamespaceSeq);
+    more = reclaimDeferredBlocks(RECLAIM_STEPS_PER_LOCK);
+    write_seqcount_end(&rdNamespaceSeq);
+    mutex_unlock(&rdLock);
+    cond_resched();
+  }
+}
+
+// largest image rd_snapshot_kernel can produce, every block in an extent of its own
+#define RD_MAX_IMAGE_LEN ((int)(sizeof(struct rd_image_header) + \
+  TOTAL_BLK_COUNT * (BLOCK_SIZE + sizeof(struct rd_image_extent))))
+
+// user data RD_WRITE copies in per step
+#define RD_WRITE_STAGE_LEN 16384
+
+// RD_WRITE, the data is copied in a stage at a time and written from kernel memory, so the user
+// copy, which can fault and sleep, stays out of the write section
+// returns the bytes written, -1 if the first stage could not be written
+static int stagedWrite(int handle, const char *address, int numBytes, int *newPos)
+{
+  int stageLen = (numBytes < RD_WRITE_STAGE_LEN) ? numBytes : RD_WRITE_STAGE_LEN;
+  char *stage = (char *)kmalloc((stageLen > 0) ? stageLen : 1, GFP_KERNEL);
+  if (NULL == stage) {
+    return -1;
+  }
 
+  int written = 0;
+  int len = 0;
+  int ret = 0;
+  do {
+    len = (numBytes - written < stageLen) ? (numBytes - written) : stageLen;
+    if ((len > 0) && (0 != copy_from_user(stage, address + written, len))) {
+      ret = -1;
+      break;
+    }
+    write_seqcount_begin(&rdNamespaceSeq);
+    ret = rd_write_kernel(handle, stage, len, newPos);
+    write_seqcount_end(&rdNamespaceSeq);
+    if (ret <= 0) {
+      break;
+    }
+    written = written + ret;
+  } while ((ret == len) && (written < numBytes));
+  kfree(stage);
+
+  return (written > 0) ? written : ret;
+}
 
 // based on ioctl call from primer
-static int rd_ioctl(struct inode *inode, struct file *file,
-				unsigned int cmd, unsigned long arg)
+static int rd_ioctl_locked(struct file *file, unsigned int cmd, unsigned long arg)
 {
 
   struct pathParam creatParams;
   struct pathParam mkdirParams;
-  struct openParam openParams;
   struct closeParam closeParams;
   struct rwParam readParams;
   struct rwParam writeParams;
   struct lseekParam lseekParams;
   struct pathParam unlinkParams;
   struct readdirParam readdirParams;
+  struct imageParam imageParams;
+  struct pathPairParam cloneParams;
+  struct pathPairParam renameParams;
+  struct pathPairParam linkParams;
+  struct readdirplusParam readdirplusParams;
+  struct atParam atParams;
+  struct openHandleParam openHandleParams;
+  struct pathParam rmtreeParams;
+  struct createManyParam createManyParams;
+  struct fragReportParam fragReportParams;
+  struct pathParam defragParams;
+  struct flagsParam flagsParams;
+  struct zeroRangeParam zeroRangeParams;
   char *path = NULL;
+  char *dstPath = NULL;
 
   switch (cmd)
   {
   case RD_CREAT:
     copy_from_user(&creatParams, (struct pathParam *)arg, sizeof(struct pathParam));
-    path = strdup(&creatParams.path);
-    int retCreat = rd_creat_kernel(path);
+    path = getUserPath(creatParams.path, creatParams.pathLen);
+    int retCreat = -1;
+    if (NULL != path) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retCreat = rd_creat_kernel(path);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
     creatParams.returnVal = retCreat;
-    copy_to_user((int *)arg, &creatParams.returnVal, sizeof(int));
+    copy_to_user((struct pathParam *)arg, &creatParams, sizeof(struct pathParam));
     kfree(path);
     break;
 
   case RD_MKDIR:
     copy_from_user(&mkdirParams, (struct pathParam *)arg, sizeof(struct pathParam));
-    path = strdup(&mkdirParams.path);
-    int retMkdir = rd_mkdir_kernel(path);
+    path = getUserPath(mkdirParams.path, mkdirParams.pathLen);
+    int retMkdir = -1;
+    if (NULL != path) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retMkdir = rd_mkdir_kernel(path);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
     mkdirParams.returnVal = retMkdir;
-    copy_to_user((int *)arg, &mkdirParams.returnVal, sizeof(int));
+    copy_to_user((struct pathParam *)arg, &mkdirParams, sizeof(struct pathParam));
     kfree(path);
     break;
 
-  case RD_OPEN:
-    copy_from_user(&openParams, (struct openParam *)arg, sizeof(struct openParam));
-    path = strdup(&openParams.path);
-    int retOpen =  = rd_open_kernel(path, &openParams.inodeNum);
-    openParams.returnVal = retOpen;
-    copy_to_user((struct openParam *)arg, &openParams, sizeof(struct openParam));
+  case RD_CREATAT:
+    copy_from_user(&atParams, (struct atParam *)arg, sizeof(struct atParam));
+    path = getUserPath(atParams.path, atParams.pathLen);
+    int retCreatAt = -1;
+    if (NULL != path) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retCreatAt = rd_creatat_kernel(atParams.dirHandle, path);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
+    atParams.returnVal = retCreatAt;
+    copy_to_user((struct atParam *)arg, &atParams, sizeof(struct atParam));
+    kfree(path);
+    break;
+
+  case RD_MKDIRAT:
+    copy_from_user(&atParams, (struct atParam *)arg, sizeof(struct atParam));
+    path = getUserPath(atParams.path, atParams.pathLen);
+    int retMkdirAt = -1;
+    if (NULL != path) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retMkdirAt = rd_mkdirat_kernel(atParams.dirHandle, path);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
+    atParams.returnVal = retMkdirAt;
+    copy_to_user((struct atParam *)arg, &atParams, sizeof(struct atParam));
     kfree(path);
     break;
 
+  case RD_OPENAT:
+    copy_from_user(&atParams, (struct atParam *)arg, sizeof(struct atParam));
+    path = getUserPath(atParams.path, atParams.pathLen);
+    int retOpenAt = -1;
+    if (NULL != path) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retOpenAt = rd_openat_kernel(atParams.dirHandle, path, &atParams.handle);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
+    atParams.returnVal = retOpenAt;
+    copy_to_user((struct atParam *)arg, &atParams, sizeof(struct atParam));
+    kfree(path);
+    break;
+
+  case RD_UNLINKAT:
+    copy_from_user(&atParams, (struct atParam *)arg, sizeof(struct atParam));
+    path = getUserPath(atParams.path, atParams.pathLen);
+    int retUnlinkAt = -1;
+    if (NULL != path) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retUnlinkAt = rd_unlinkat_kernel(atParams.dirHandle, path);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
+    atParams.returnVal = retUnlinkAt;
+    copy_to_user((struct atParam *)arg, &atParams, sizeof(struct atParam));
+    kfree(path);
+    break;
+
+  case RD_OPEN_BY_HANDLE:
+    copy_from_user(&openHandleParams, (struct openHandleParam *)arg, sizeof(struct openHandleParam));
+    write_seqcount_begin(&rdNamespaceSeq);
+    int retOpenByHandle = rd_open_by_handle_kernel(&openHandleParams.fileHandle, &openHandleParams.handle);
+    write_seqcount_end(&rdNamespaceSeq);
+    openHandleParams.returnVal = retOpenByHandle;
+    copy_to_user((struct openHandleParam *)arg, &openHandleParams, sizeof(struct openHandleParam));
+    break;
+
   case RD_CLOSE:
     copy_from_user(&closeParams, (struct closeParam *)arg, sizeof(struct closeParam));
-    int retClose = rd_close_kernel(closeParams.inodeNum);
+    write_seqcount_begin(&rdNamespaceSeq);
+    int retClose = rd_close_kernel(closeParams.handle);
+    write_seqcount_end(&rdNamespaceSeq);
     closeParams.returnVal = retClose;
     copy_to_user((int *)arg, &closeParams.returnVal, sizeof(int));
     break;
 
   case RD_READ:
     copy_from_user(&readParams, (struct rwParam *)arg, sizeof(struct rwParam));
-    int retRead =  = rd_read_kernel(readParams.inodeNum, readParams.filePosition, readParams.address, readParams.numBytes);
+    int retRead = rd_read_kernel(readParams.handle, readParams.address, readParams.numBytes, &readParams.filePosition);
     readParams.returnVal = retRead;
     copy_to_user((struct rwParam *)arg, &readParams, sizeof(struct rwParam));
     break;
 
   case RD_WRITE:
     copy_from_user(&writeParams, (struct rwParam *)arg, sizeof(struct rwParam));
-    int retWrite = rd_write_kernel(writeParams.inodeNum, writeParams.filePosition, writeParams.address, writeParams.numBytes);
-    writeParams.returnVal = retWrite;
+    writeParams.returnVal = stagedWrite(writeParams.handle, writeParams.address, writeParams.numBytes,
+      &writeParams.filePosition);
     copy_to_user((struct rwParam *)arg, &writeParams, sizeof(struct rwParam));
     break;
 
   case RD_LSEEK:
     copy_from_user(&lseekParams, (struct lseekParam *)arg, sizeof(struct lseekParam));
     int offset_toReturn = 0;
-    int retLseek = rd_lseek_kernel(lseekParams.inodeNum, lseekParams.offset, &offset_toReturn);
+    int retLseek = rd_lseek_kernel(lseekParams.handle, lseekParams.offset, &offset_toReturn);
     lseekParams.returnVal = retLseek;
     if (0 == lseekParams.returnVal) {
       lseekParams.offset_toReturn = offset_toReturn;
@@ -155,23 +478,185 @@ static int rd_ioctl(struct inode *inode, struct file *file,
 
   case RD_UNLINK:
     copy_from_user(&unlinkParams, (struct pathParam *)arg, sizeof(struct pathParam));
-    path = strdup(&unlinkParams.path);
-    int retUnlink = rd_unlink_kernel(path);
+    path = getUserPath(unlinkParams.path, unlinkParams.pathLen);
+    int retUnlink = -1;
+    if (NULL != path) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retUnlink = rd_unlink_kernel(path);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
     unlinkParams.returnVal = retUnlink;
-    copy_to_user((int *)arg, &unlinkParams.returnVal, sizeof(int));
+    copy_to_user((struct pathParam *)arg, &unlinkParams, sizeof(struct pathParam));
     kfree(path);
     break;
 
   case RD_READDIR:
     copy_from_user(&readdirParams, (struct readdirParam *)arg, sizeof(struct readdirParam));
-    int retReaddir = rd_readdir_kernel(readdirParams.inodeNum, readdirParams.address, &readdirParams.filePosition);
+    int retReaddir = rd_readdir_kernel(readdirParams.handle, readdirParams.address);
     readdirParams.returnVal = retReaddir;
     if (readdirParams.returnVal > 0) {
-      readdirParams.dirDataLen = ((int)sizeof(struct directory_entry));
+      readdirParams.dirDataLen = ((int)sizeof(struct rd_dirent));
     }
     copy_to_user((struct readdirParam *)arg, &readdirParams, sizeof(struct readdirParam));
     break;
 
+  case RD_READDIRPLUS:
+    copy_from_user(&readdirplusParams, (struct readdirplusParam *)arg, sizeof(struct readdirplusParam));
+    int retReaddirplus = rd_readdirplus_kernel(readdirplusParams.handle, readdirplusParams.address,
+      readdirplusParams.maxEntries);
+    readdirplusParams.returnVal = retReaddirplus;
+    copy_to_user((struct readdirplusParam *)arg, &readdirplusParams, sizeof(struct readdirplusParam));
+    break;
+
+  case RD_SNAPSHOT:
+    copy_from_user(&imageParams, (struct imageParam *)arg, sizeof(struct imageParam));
+    // blocks still waiting to be reclaimed would be saved as used, free them first
+    write_seqcount_begin(&rdNamespaceSeq);
+    reclaimAllDeferredBlocks();
+    write_seqcount_end(&rdNamespaceSeq);
+    int retSnapshot = rd_snapshot_kernel(imageParams.address, imageParams.bufLen, &imageParams.imageLen);
+    imageParams.returnVal = retSnapshot;
+    copy_to_user((struct imageParam *)arg, &imageParams, sizeof(struct imageParam));
+    break;
+
+  case RD_RESTORE:
+    copy_from_user(&imageParams, (struct imageParam *)arg, sizeof(struct imageParam));
+    int retRestore = -1;
+    char *image = NULL;
+    if ((imageParams.imageLen > 0) && (imageParams.imageLen <= RD_MAX_IMAGE_LEN)) {
+      image = (char *)vmalloc(imageParams.imageLen);
+    }
+    if ((NULL != image) && (0 == copy_from_user(image, imageParams.address, imageParams.imageLen))) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retRestore = rd_restore_kernel(image, imageParams.imageLen);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
+    vfree(image);
+    imageParams.returnVal = retRestore;
+    copy_to_user((struct imageParam *)arg, &imageParams, sizeof(struct imageParam));
+    break;
+
+  case RD_CLONE:
+    copy_from_user(&cloneParams, (struct pathPairParam *)arg, sizeof(struct pathPairParam));
+    path = getUserPath(cloneParams.srcPath, cloneParams.srcPathLen);
+    dstPath = getUserPath(cloneParams.dstPath, cloneParams.dstPathLen);
+    int retClone = -1;
+    if ((NULL != path) && (NULL != dstPath)) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retClone = rd_clone_kernel(path, dstPath);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
+    cloneParams.returnVal = retClone;
+    copy_to_user((struct pathPairParam *)arg, &cloneParams, sizeof(struct pathPairParam));
+    kfree(path);
+    kfree(dstPath);
+    break;
+
+  case RD_SETFLAGS:
+    copy_from_user(&flagsParams, (struct flagsParam *)arg, sizeof(struct flagsParam));
+    path = getUserPath(flagsParams.path, flagsParams.pathLen);
+    int retSetFlags = -1;
+    if (NULL != path) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retSetFlags = rd_setflags_kernel(path, flagsParams.flags);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
+    flagsParams.returnVal = retSetFlags;
+    copy_to_user((struct flagsParam *)arg, &flagsParams, sizeof(struct flagsParam));
+    kfree(path);
+    break;
+
+  case RD_ZERO_RANGE:
+    copy_from_user(&zeroRangeParams, (struct zeroRangeParam *)arg, sizeof(struct zeroRangeParam));
+    write_seqcount_begin(&rdNamespaceSeq);
+    int retZeroRange = rd_zero_range_kernel(zeroRangeParams.handle, zeroRangeParams.offset, zeroRangeParams.length);
+    write_seqcount_end(&rdNamespaceSeq);
+    zeroRangeParams.returnVal = retZeroRange;
+    copy_to_user((struct zeroRangeParam *)arg, &zeroRangeParams, sizeof(struct zeroRangeParam));
+    break;
+
+  case RD_RENAME:
+    copy_from_user(&renameParams, (struct pathPairParam *)arg, sizeof(struct pathPairParam));
+    path = getUserPath(renameParams.srcPath, renameParams.srcPathLen);
+    dstPath = getUserPath(renameParams.dstPath, renameParams.dstPathLen);
+    int retRename = -1;
+    if ((NULL != path) && (NULL != dstPath)) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retRename = rd_rename_kernel(path, dstPath);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
+    renameParams.returnVal = retRename;
+    copy_to_user((struct pathPairParam *)arg, &renameParams, sizeof(struct pathPairParam));
+    kfree(path);
+    kfree(dstPath);
+    break;
+
+  case RD_LINK:
+    copy_from_user(&linkParams, (struct pathPairParam *)arg, sizeof(struct pathPairParam));
+    path = getUserPath(linkParams.srcPath, linkParams.srcPathLen);
+    dstPath = getUserPath(linkParams.dstPath, linkParams.dstPathLen);
+    int retLink = -1;
+    if ((NULL != path) && (NULL != dstPath)) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retLink = rd_link_kernel(path, dstPath);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
+    linkParams.returnVal = retLink;
+    copy_to_user((struct pathPairParam *)arg, &linkParams, sizeof(struct pathPairParam));
+    kfree(path);
+    kfree(dstPath);
+    break;
+
+  case RD_RMTREE:
+    copy_from_user(&rmtreeParams, (struct pathParam *)arg, sizeof(struct pathParam));
+    path = getUserPath(rmtreeParams.path, rmtreeParams.pathLen);
+    int retRmtree = -1;
+    if (NULL != path) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retRmtree = rd_rmtree_kernel(path);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
+    rmtreeParams.returnVal = retRmtree;
+    copy_to_user((struct pathParam *)arg, &rmtreeParams, sizeof(struct pathParam));
+    kfree(path);
+    break;
+
+  case RD_CREATE_MANY:
+    copy_from_user(&createManyParams, (struct createManyParam *)arg, sizeof(struct createManyParam));
+    path = getUserPath(createManyParams.dirPath, createManyParams.dirPathLen);
+    char *names = getUserString(createManyParams.names, createManyParams.namesLen, RD_MAX_NAMES_LEN);
+    int retCreateMany = -1;
+    if ((NULL != path) && (NULL != names)) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retCreateMany = rd_create_many_kernel(path, names, createManyParams.namesLen, createManyParams.count);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
+    createManyParams.returnVal = retCreateMany;
+    copy_to_user((struct createManyParam *)arg, &createManyParams, sizeof(struct createManyParam));
+    kfree(path);
+    kfree(names);
+    break;
+
+  case RD_FRAG_REPORT:
+    fillFragReport(&fragReportParams.report);
+    fragReportParams.returnVal = 0;
+    copy_to_user((struct fragReportParam *)arg, &fragReportParams, sizeof(struct fragReportParam));
+    break;
+
+  case RD_DEFRAG:
+    copy_from_user(&defragParams, (struct pathParam *)arg, sizeof(struct pathParam));
+    path = getUserPath(defragParams.path, defragParams.pathLen);
+    int retDefrag = -1;
+    if (NULL != path) {
+      write_seqcount_begin(&rdNamespaceSeq);
+      retDefrag = rd_defrag_kernel(path);
+      write_seqcount_end(&rdNamespaceSeq);
+    }
+    defragParams.returnVal = retDefrag;
+    copy_to_user((struct pathParam *)arg, &defragParams, sizeof(struct pathParam));
+    kfree(path);
+    break;
+
   default:
     return -EINVAL;
     break;
@@ -181,8 +666,10 @@ static int rd_ioctl(struct inode *inode, struct file *file,
 }
 
 
+#ifndef RD_USERSPACE
 module_init(initialization_routine); 
 module_exit(cleanup_routine); 
+#endif
 
 
 
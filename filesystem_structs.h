@@ -1,52 +1,218 @@
 #ifndef _FILESYSTEM_STRUCTS_H
 #define _FILESYSTEM_STRUCTS_H
 
-// parameter for rd_creat, rd_mkdir, rd_unlink
+// ramdisk block size, userspace aligns buffered writes to it
+#define RD_BLOCK_SIZE 256
+
+// longest file or directory name
+#define RD_MAX_NAME_LEN 59
+
+// longest path accepted by the path taking calls
+#define RD_MAX_PATH_LEN 4096
+
+// most bytes of names rd_create_many hands the kernel in one call
+#define RD_MAX_NAMES_LEN 16384
+
+// directory entry as handed to userspace by readdir
+struct rd_dirent {
+  char filename[RD_MAX_NAME_LEN + 1];
+  int inodeNum;
+};
+
+// kinds of entry reported in rd_stat.type
+#define RD_TYPE_FILE 1
+#define RD_TYPE_DIR 2
+
+// names a file independently of its path, stale once the inode is freed and reused
+struct rd_file_handle {
+  int inodeNum;
+  unsigned int generation;
+};
+
+// attributes of a file or directory as handed to userspace by rd_stat and rd_readdirplus
+struct rd_stat {
+  int inodeNum;
+  unsigned int generation; // with inodeNum, the rd_file_handle of the file
+  int type;
+  int size;
+  int blocks; // data and block pointer table blocks the inode references, inline contents take none
+  int linkCount;
+  int openCount;
+  int flags; // RD_FLAG_* modes
+  int extents; // runs of consecutive blocks the data is stored in, rd_defrag brings it down to one
+};
+
+// directory entry together with the attributes of the inode it names
+struct rd_direntplus {
+  struct rd_dirent dirent;
+  struct rd_stat stat;
+};
+
+// free space layout reported by rd_fragreport
+// bucket i of freeExtentHistogram counts free extents of 2^i up to 2^(i+1) - 1 blocks
+#define RD_FRAG_BUCKETS 14
+struct rd_frag_report {
+  int totalBlocks;
+  int freeBlocks;
+  int freeExtents;
+  int largestFreeExtent;
+  int freeExtentHistogram[RD_FRAG_BUCKETS];
+};
+
+// parameter for rd_creat, rd_mkdir, rd_unlink, rd_rmtree, rd_defrag
 struct pathParam {
   int pathLen;
   const char *path;
   int returnVal;
 };
 
-//parameter for read/write
+//parameter for read/write, position is kept by the kernel open file
+//and filePosition returns where it is after the call
 struct rwParam {
-  int inodeNum;
+  int handle;
   char *address;
-  int filePosition;
   int numBytes;
+  int filePosition;
+  int returnVal;
+};
+
+// parameter for rd_zero_range, zeroes length bytes at offset of the open file
+struct zeroRangeParam {
+  int handle;
+  int offset;
+  int length;
+  int returnVal;
+};
+
+// per file modes for rd_setflags, set on a directory they pass down to entries created in it
+#define RD_FLAG_DEDUP 0x2 // full block writes share an existing block with identical contents
+#define RD_FLAG_COMPRESS 0x4 // data is stored lz4 compressed in chunks of several blocks
+
+// parameter for rd_setflags
+struct flagsParam {
+  int pathLen;
+  const char *path;
+  int flags;
   int returnVal;
 };
 
-// parameter for rd_open
+// parameter for calls taking a source and a destination path (rd_clone, rd_rename, rd_link)
+struct pathPairParam {
+  int srcPathLen;
+  const char *srcPath;
+  int dstPathLen;
+  const char *dstPath;
+  int returnVal;
+};
+
+// parameter for rd_creatat, rd_mkdirat, rd_openat and rd_unlinkat, path starts at the directory open
+// at dirHandle unless it begins with '/', handle receives the open file of rd_openat
+struct atParam {
+  int dirHandle;
+  int pathLen;
+  const char *path;
+  int handle;
+  int returnVal;
+};
+
+// parameter for rd_create_many, names holds count NUL terminated names back to back in namesLen bytes
+// and returnVal receives how many files were created, in order, before the first failure
+struct createManyParam {
+  int dirPathLen;
+  const char *dirPath;
+  int namesLen;
+  const char *names;
+  int count;
+  int returnVal;
+};
+
+// parameter for rd_fragreport
+struct fragReportParam {
+  struct rd_frag_report report;
+  int returnVal;
+};
+
+// parameter for rd_open, handle refers to the kernel open file
 struct openParam {
   int pathLen;
   const char *path;
-  int inodeNum;
+  int handle;
+  int returnVal;
+};
+
+// parameter for rd_open_by_handle
+struct openHandleParam {
+  struct rd_file_handle fileHandle;
+  int handle;
   int returnVal;
 };
 
 //parameter for rd_close
 struct closeParam {
-  int inodeNum;
+  int handle;
   int returnVal;
 };
 
 // parameter for lseek
 struct lseekParam {
   int returnVal;
-  int inodeNum;
+  int handle;
   int offset;
   int offset_toReturn;
 };
 
-// parameter for readdir
+// parameter for readdir, the directory cursor lives with the open file
 struct readdirParam {
-  int inodeNum;
-  char address[16];
-  int filePosition;
+  int handle;
+  char address[sizeof(struct rd_dirent)];
   int dirDataLen;
   int returnVal;
 };
 
+// parameter for rd_stat
+struct statParam {
+  int pathLen;
+  const char *path;
+  struct rd_stat stat;
+  int returnVal;
+};
+
+// parameter for rd_readdirplus, returnVal receives the number of entries stored at address
+struct readdirplusParam {
+  int handle;
+  struct rd_direntplus *address;
+  int maxEntries;
+  int returnVal;
+};
+
+
+// parameter for snapshot/restore of the whole ramdisk image
+struct imageParam {
+  char *address;
+  int bufLen;
+  int imageLen;
+  int returnVal;
+};
+
+// IMAGE FORMAT
+// header, then metaBlocks blocks (superblock, inode array, bitmap) copied verbatim,
+// then extentCount runs of used data blocks, each an rd_image_extent followed by its blocks
+#define RD_IMAGE_MAGIC 0x52444931
+#define RD_IMAGE_VERSION 5
+
+struct rd_image_header {
+  int magic;
+  int version;
+  int blockSize;
+  int totalBlocks;
+  int metaBlocks;
+  int extentCount;
+};
+
+struct rd_image_extent {
+  int start;
+  int count;
+};
+
 
 #endif
\ No newline at end of file
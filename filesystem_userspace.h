@@ -0,0 +1,173 @@
+#ifndef _FILESYSTEM_USERSPACE_H
+#define _FILESYSTEM_USERSPACE_H
+
+// stand-ins for the kernel facilities the engine uses, so filesystem_kernel.c and
+// filesystem_functions_kernel.h build into a normal process with -DRD_USERSPACE
+// "user" addresses are plain pointers in the same address space
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <lz4.h>
+
+#define vmalloc(size) malloc(size)
+#define vfree(address) free(address)
+
+// bytes left uncopied, never any
+static inline unsigned long copy_to_user(void *to, const void *from, unsigned long n)
+{
+  memcpy(to, from, n);
+  return 0;
+}
+
+static inline unsigned long copy_from_user(void *to, const void *from, unsigned long n)
+{
+  memcpy(to, from, n);
+  return 0;
+}
+
+static inline unsigned long clear_user(void *to, unsigned long n)
+{
+  memset(to, 0, n);
+  return 0;
+}
+
+// first byte of the n at start that isn't c, NULL if there is none
+static inline void *memchr_inv(const void *start, int c, size_t n)
+{
+  const unsigned char *bytes = (const unsigned char *)start;
+  const unsigned long pattern = (unsigned char)c * (~0UL / 0xFF);
+
+  // a word at a time while the rest stays word aligned
+  while ((n >= sizeof(unsigned long)) && (0 == ((unsigned long)bytes % sizeof(unsigned long)))) {
+    if (pattern != *(const unsigned long *)bytes) {
+      break;
+    }
+    bytes += sizeof(unsigned long);
+    n -= sizeof(unsigned long);
+  }
+  for (; n > 0; bytes++, n--) {
+    if ((unsigned char)c != *bytes) {
+      return (void *)bytes;
+    }
+  }
+  return NULL;
+}
+
+#define prefetch(address) __builtin_prefetch(address)
+
+// liblz4 takes the compression state as a separate call, the kernel as a trailing argument
+#define LZ4_MEM_COMPRESS LZ4_sizeofState()
+#define LZ4_compress_default(source, dest, inputSize, maxOutputSize, wrkmem) \
+  LZ4_compress_fast_extState((wrkmem), (source), (dest), (inputSize), (maxOutputSize), 1)
+
+#define BUILD_BUG_ON(condition) ((void)sizeof(char[1 - 2 * !!(condition)]))
+
+// what the ioctl dispatch in filesystem_main.c needs, for drivers calling rd_ioctl in process
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+struct file;
+
+#define GFP_KERNEL 0
+#define kmalloc(size, flags) malloc(size)
+#define kfree(address) free(address)
+
+#define DEFINE_MUTEX(name) pthread_mutex_t name = PTHREAD_MUTEX_INITIALIZER
+#define mutex_lock(lock) pthread_mutex_lock(lock)
+#define mutex_unlock(lock) pthread_mutex_unlock(lock)
+
+#define cpu_relax() ((void)0)
+#define cond_resched() sched_yield()
+
+// odd while a writer is inside, readers retry if it moved while they read
+typedef struct {
+  unsigned int sequence;
+} seqcount_t;
+
+static inline void seqcount_init(seqcount_t *seq)
+{
+  seq->sequence = 0;
+}
+
+// the lock a write section is held under goes unchecked here
+typedef seqcount_t seqcount_mutex_t;
+#define seqcount_mutex_init(seq, lock) seqcount_init(seq)
+
+static inline unsigned int raw_seqcount_begin(seqcount_t *seq)
+{
+  return __atomic_load_n(&seq->sequence, __ATOMIC_ACQUIRE) & ~1U;
+}
+
+static inline int read_seqcount_retry(seqcount_t *seq, unsigned int start)
+{
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&seq->sequence, __ATOMIC_RELAXED) != start;
+}
+
+static inline void write_seqcount_begin(seqcount_t *seq)
+{
+  __atomic_store_n(&seq->sequence, seq->sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void write_seqcount_end(seqcount_t *seq)
+{
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&seq->sequence, seq->sequence + 1, __ATOMIC_RELAXED);
+}
+
+// a work item runs on a thread of its own, started by its first schedule_work
+struct work_struct {
+  void (*func)(struct work_struct *work);
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  int pending;
+  int started;
+};
+
+#define DECLARE_WORK(name, workFunc) struct work_struct name = \
+  { .func = (workFunc), .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER }
+
+static inline void *workThread(void *arg)
+{
+  struct work_struct *work = (struct work_struct *)arg;
+
+  pthread_mutex_lock(&work->lock);
+  for (;;) {
+    while (!work->pending) {
+      pthread_cond_wait(&work->wake, &work->lock);
+    }
+    work->pending = 0;
+    pthread_mutex_unlock(&work->lock);
+    work->func(work);
+    pthread_mutex_lock(&work->lock);
+  }
+  return NULL;
+}
+
+// queue work unless it is already waiting to run, returns non zero if it was queued here
+static inline int schedule_work(struct work_struct *work)
+{
+  pthread_mutex_lock(&work->lock);
+  if (!work->started) {
+    pthread_t thread;
+    if (0 == pthread_create(&thread, NULL, workThread, work)) {
+      pthread_detach(thread);
+      work->started = 1;
+    }
+  }
+  int queued = !work->pending;
+  work->pending = 1;
+  pthread_cond_signal(&work->wake);
+  pthread_mutex_unlock(&work->lock);
+
+  return queued;
+}
+
+#endif
\ No newline at end of file